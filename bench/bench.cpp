@@ -0,0 +1,287 @@
+/*
+ * Tail latency of parse, access, stringify and free with many threads
+ * allocating at once.
+ *
+ *     leptjson_bench [-t threads] [-n docs per thread] [-m mode] [-s seed]
+ *
+ * Each thread parses, walks, stringifies and frees a stream of documents of
+ * mixed sizes (mostly small objects, some arrays of records, a few large
+ * documents), timing every operation into its own histograms, which are
+ * merged for the report. The threads start together so that their new[] and
+ * delete[] calls contend from the first document on.
+ *
+ * Modes change how the trees are allocated or freed:
+ *     inline     frees each tree on the thread that parsed it (the default)
+ *     reclaimer  hands each tree to a per-thread LeptReclaimer
+ *     shapes     parses with LEPT_PARSE_FLAG_SHAPES: objects of one key
+ *                sequence share their keys, which are allocated once per
+ *                shape instead of once per member
+ *     all        runs the three in turn
+ *
+ * To compare malloc implementations, run the same mode with each one
+ * preloaded (LD_PRELOAD=libjemalloc.so ...). Configure with
+ * -DCMAKE_BUILD_TYPE=Release for numbers worth comparing.
+ */
+#include "../source/leptjson.h"
+#include "../source/leptreclaimer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum bench_op { BENCH_PARSE, BENCH_ACCESS, BENCH_STRINGIFY, BENCH_FREE, BENCH_OPS };
+static const char *bench_op_names[BENCH_OPS] = { "parse", "access", "stringify", "free" };
+
+enum bench_mode { BENCH_INLINE, BENCH_RECLAIMER, BENCH_SHAPES, BENCH_MODES };
+static const char *bench_mode_names[BENCH_MODES] = { "inline", "reclaimer", "shapes" };
+
+/*
+ * Log-linear histogram of nanoseconds: values below 16 have a bucket each,
+ * and every power of two above is cut into 16 buckets, so a bucket is within
+ * 1/16 of the values in it.
+ */
+class histogram
+{
+  public:
+    histogram() : counts_(64 * 16, 0), n_(0), sum_(0), max_(0) {}
+
+    void add(uint64_t ns)
+    {
+        ++counts_[bucket(ns)];
+        ++n_;
+        sum_ += ns;
+        max_ = std::max(max_, ns);
+    }
+    void merge(const histogram &h)
+    {
+        for (size_t i = 0; i < counts_.size(); ++i)
+            counts_[i] += h.counts_[i];
+        n_ += h.n_;
+        sum_ += h.sum_;
+        max_ = std::max(max_, h.max_);
+    }
+
+    uint64_t count() const  { return n_; }
+    uint64_t max() const    { return max_; }
+    double   mean() const   { return n_ ? (double)sum_ / n_ : 0; }
+    // the upper bound of the bucket holding quantile q
+    uint64_t quantile(double q) const
+    {
+        uint64_t rank = (uint64_t)(q * n_ + 0.5), seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+            if ((seen += counts_[i]) >= std::max<uint64_t>(rank, 1))
+                return std::min(upper(i), max_);
+        return max_;
+    }
+
+  private:
+    std::vector<uint64_t> counts_;
+    uint64_t n_, sum_, max_;
+
+    static size_t bucket(uint64_t v)
+    {
+        if (v < 16)
+            return (size_t)v;
+        int e = 63 - __builtin_clzll(v);
+        return (size_t)(e - 3) * 16 + (size_t)((v >> (e - 4)) - 16);
+    }
+    static uint64_t upper(size_t i)
+    {
+        if (i < 16)
+            return i;
+        int e = (int)(i / 16) + 3;
+        return ((i % 16 + 17) << (e - 4)) - 1;
+    }
+};
+
+// documents of three sizes; ids and values vary so the trees are not all alike
+static std::string bench_small(std::mt19937 &rng)
+{
+    return "{\"id\":" + std::to_string(rng() % 100000) + ",\"name\":\"user" + std::to_string(rng() % 1000) +
+           "\",\"active\":" + (rng() % 2 ? "true" : "false") + ",\"score\":" + std::to_string((rng() % 10000) / 100.0) +
+           ",\"tags\":[\"a\",\"b\",\"c\"],\"addr\":{\"city\":\"x\",\"zip\":\"12345\"}}";
+}
+
+static std::string bench_records(std::mt19937 &rng, size_t n)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i)
+            json += ',';
+        json += bench_small(rng);
+    }
+    return json + "]";
+}
+
+struct bench_corpus
+{
+    std::vector<std::string> small, medium, large;
+
+    explicit bench_corpus(unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        for (int i = 0; i < 64; ++i)
+            small.push_back(bench_small(rng));
+        for (int i = 0; i < 16; ++i)
+            medium.push_back(bench_records(rng, 100));     // ~15 KB
+        for (int i = 0; i < 2; ++i)
+            large.push_back(bench_records(rng, 8000));     // ~1.2 MB
+    }
+    // 90% small, 9.5% medium, 0.5% large
+    const std::string& pick(std::mt19937 &rng) const
+    {
+        unsigned r = rng() % 1000;
+        if (r < 900)
+            return small[rng() % small.size()];
+        if (r < 995)
+            return medium[rng() % medium.size()];
+        return large[rng() % large.size()];
+    }
+};
+
+// reads every value once, so that the parse cannot be judged by a tree nobody looks at
+static size_t bench_touch(const lept_value &root)
+{
+    std::vector<const lept_value*> stack(1, &root);
+    size_t sum = 0;
+    while (!stack.empty()) {
+        const lept_value &v = *stack.back();
+        stack.pop_back();
+        switch (v.type) {
+            case LEPT_NUMBER: sum += (size_t)lept_value_get_number(v); break;
+            case LEPT_STRING: sum += v.u.s.len; break;
+            case LEPT_ARRAY:
+                for (size_t i = 0; i < lept_value_get_array_size(v); ++i)
+                    stack.push_back(lept_value_get_array_element(v, i));
+                break;
+            case LEPT_OBJECT:
+                for (size_t i = 0; i < lept_value_get_object_size(v); ++i) {
+                    sum += lept_value_get_object_key_length(v, i);
+                    stack.push_back(lept_value_get_object_value(v, i));
+                }
+                break;
+            default: ++sum;
+        }
+    }
+    return sum;
+}
+
+struct bench_worker
+{
+    histogram ops[BENCH_OPS];
+    size_t touched = 0, failed = 0;
+};
+
+static uint64_t bench_since(std::chrono::steady_clock::time_point &t)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - t).count();
+    t = now;
+    return ns;
+}
+
+static void bench_run(const bench_corpus &corpus, bench_worker &w, bench_mode mode, size_t docs, unsigned seed,
+                      std::atomic<unsigned> &ready, unsigned threads)
+{
+    std::mt19937 rng(seed);
+    std::unique_ptr<LeptReclaimer> reclaimer(mode == BENCH_RECLAIMER ? new LeptReclaimer : nullptr);
+    ready.fetch_add(1);
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    for (size_t i = 0; i < docs; ++i) {
+        const std::string &json = corpus.pick(rng);
+        std::unique_ptr<LeptJson> doc(new LeptJson);
+        doc->set_reclaimer(reclaimer.get());
+        std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+        int ret = (mode == BENCH_SHAPES ? doc->parse<LEPT_PARSE_FLAG_SHAPES>(json) : doc->parse(json));
+        w.ops[BENCH_PARSE].add(bench_since(t));
+        if (ret != LEPT_PARSE_OK) {
+            ++w.failed;
+            continue;
+        }
+        w.touched += bench_touch(doc->get_value());
+        w.ops[BENCH_ACCESS].add(bench_since(t));
+        size_t len;
+        doc->stringify(&len);
+        w.ops[BENCH_STRINGIFY].add(bench_since(t));
+        doc.reset(); // the tree and the stringify output
+        w.ops[BENCH_FREE].add(bench_since(t));
+    }
+}
+
+static void bench_report(bench_mode mode, const std::vector<bench_worker> &workers, double seconds)
+{
+    histogram total[BENCH_OPS];
+    size_t failed = 0;
+    for (const bench_worker &w : workers) {
+        for (int op = 0; op < BENCH_OPS; ++op)
+            total[op].merge(w.ops[op]);
+        failed += w.failed;
+    }
+    printf("\nmode %s: %zu threads, %.0f docs/s%s\n", bench_mode_names[mode], workers.size(),
+           total[BENCH_PARSE].count() / seconds, failed ? " (some documents failed to parse)" : "");
+    printf("%-10s %10s %10s %10s %10s %10s %10s %12s\n", "op (us)", "count", "mean", "p50", "p90", "p99", "p999", "max");
+    for (int op = 0; op < BENCH_OPS; ++op) {
+        const histogram &h = total[op];
+        printf("%-10s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f %12.2f\n", bench_op_names[op],
+               (unsigned long long)h.count(), h.mean() / 1e3, h.quantile(0.5) / 1e3, h.quantile(0.9) / 1e3,
+               h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3, h.max() / 1e3);
+    }
+}
+
+static int bench_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-n docs per thread] [-m inline|reclaimer|shapes|all] [-s seed]\n", name);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t docs = 20000;
+    unsigned seed = 1;
+    std::string mode = "inline";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return bench_usage(argv[0]);
+        if (arg == "-t")
+            threads = (unsigned)std::max(1L, strtol(argv[++i], nullptr, 10));
+        else if (arg == "-n")
+            docs = (size_t)strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-m")
+            mode = argv[++i];
+        else if (arg == "-s")
+            seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else
+            return bench_usage(argv[0]);
+    }
+    std::vector<bench_mode> modes;
+    for (int m = 0; m < BENCH_MODES; ++m)
+        if (mode == "all" || mode == bench_mode_names[m])
+            modes.push_back((bench_mode)m);
+    if (modes.empty())
+        return bench_usage(argv[0]);
+
+    bench_corpus corpus(seed);
+    for (bench_mode m : modes) {
+        std::vector<bench_worker> workers(threads);
+        std::vector<std::thread> pool;
+        std::atomic<unsigned> ready(0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back(bench_run, std::cref(corpus), std::ref(workers[t]), m, docs, seed + 1 + t,
+                              std::ref(ready), threads);
+        for (std::thread &t : pool)
+            t.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bench_report(m, workers, elapsed.count());
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "leptbind.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+LeptBindReader::LeptBindReader(const char *json) : depth_(0)
+{
+    ctx_.json = json;
+    ctx_.size = ctx_.top = 0;
+}
+
+int LeptBindReader::read_null()
+{
+    lept_value v;
+    return LeptJson::lept_parse_literal(ctx_, v, "null", LEPT_NULL);
+}
+
+int LeptBindReader::read_bool(bool &b)
+{
+    lept_value v;
+    int ret;
+    switch (peek()) {
+        case 't': ret = LeptJson::lept_parse_literal(ctx_, v, "true", LEPT_TRUE); break;
+        case 'f': ret = LeptJson::lept_parse_literal(ctx_, v, "false", LEPT_FALSE); break;
+        case '\0': return LEPT_PARSE_EXPECT_VALUE;
+        case 'n': case '\"': case '[': case '{': return LEPT_PARSE_TYPE_MISMATCH;
+        default: return (peek() == '-' || (peek() >= '0' && peek() <= '9')) ? 
+                        LEPT_PARSE_TYPE_MISMATCH : LEPT_PARSE_INVALID_VALUE;
+    }
+    b = (v.type == LEPT_TRUE);
+    return ret;
+}
+
+int LeptBindReader::expect_number() const
+{
+    switch (peek()) {
+        case 'n': case 't': case 'f': case '\"': case '[': case '{':
+            return LEPT_PARSE_TYPE_MISMATCH;
+        case '\0':
+            return LEPT_PARSE_EXPECT_VALUE;
+    }
+    return LEPT_PARSE_OK;
+}
+
+int LeptBindReader::read_number(double &d)
+{
+    lept_value v;
+    int ret;
+    if ((ret = expect_number()) != LEPT_PARSE_OK)
+        return ret;
+    if ((ret = LeptJson::lept_parse_number(ctx_, v)) == LEPT_PARSE_OK)
+        d = v.u.num;
+    return ret;
+}
+
+// v is only valid while the text is
+int LeptBindReader::read_number(lept_value &v)
+{
+    int ret;
+    if ((ret = expect_number()) != LEPT_PARSE_OK)
+        return ret;
+    return LeptJson::lept_parse_number<LEPT_PARSE_FLAG_LAZY_NUMBERS>(ctx_, v);
+}
+
+/*
+ * Integers are converted from their text, so that 64-bit values do not round
+ * through a double; a fraction, an exponent or a value out of range is a
+ * LEPT_PARSE_TYPE_MISMATCH.
+ */
+int LeptBindReader::read_integer(const char **text)
+{
+    double d;
+    int ret;
+    *text = ctx_.json;
+    if ((ret = read_number(d)) != LEPT_PARSE_OK)
+        return ret;
+    for (const char *p = *text; p != ctx_.json; ++p)
+        if (*p == '.' || *p == 'e' || *p == 'E')
+            return LEPT_PARSE_TYPE_MISMATCH;
+    return LEPT_PARSE_OK;
+}
+
+int LeptBindReader::read_number(long long &i)
+{
+    const char *text;
+    int ret;
+    if ((ret = read_integer(&text)) != LEPT_PARSE_OK)
+        return ret;
+    errno = 0;
+    i = strtoll(text, nullptr, 10);
+    return errno == ERANGE ? LEPT_PARSE_TYPE_MISMATCH : LEPT_PARSE_OK;
+}
+
+int LeptBindReader::read_number(unsigned long long &u)
+{
+    const char *text;
+    int ret;
+    if ((ret = read_integer(&text)) != LEPT_PARSE_OK)
+        return ret;
+    if (text[0] == '-' && !(text[1] == '0' && ctx_.json == text + 2))
+        return LEPT_PARSE_TYPE_MISMATCH;    // only -0 is in range; strtoull would negate the rest
+    errno = 0;
+    u = strtoull(text, nullptr, 10);
+    return errno == ERANGE ? LEPT_PARSE_TYPE_MISMATCH : LEPT_PARSE_OK;
+}
+
+// the decoded string lives on the reader's scratch stack and is copied once
+int LeptBindReader::read_string(std::string &s)
+{
+    char *str;
+    size_t len;
+    int ret;
+    if (peek() != '\"')
+        return peek() == '\0' ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_TYPE_MISMATCH;
+    if ((ret = LeptJson::lept_parse_string_raw(ctx_, &str, len)) == LEPT_PARSE_OK)
+        s.assign(str, len);
+    return ret;
+}
+
+int LeptBindReader::read_key(const char **k, size_t &klen)
+{
+    char *str;
+    int ret = LeptJson::lept_parse_string_raw(ctx_, &str, klen);
+    *k = str;
+    return ret;
+}
+
+int LeptBindReader::finish()
+{
+    skip_whitespace();
+    return peek() == '\0' ? LEPT_PARSE_OK : LEPT_PARSE_ROOT_NOT_SINGULAR;
+}
+
+LeptBindWriter::LeptBindWriter()
+{
+    ctx_.json = nullptr;
+    ctx_.size = ctx_.top = 0;
+}
+
+void LeptBindWriter::integer(long long i)
+{
+    ctx_.top -= 32 - sprintf((char*)ctx_.push(32), "%lld", i);
+}
+
+void LeptBindWriter::integer(unsigned long long u)
+{
+    ctx_.top -= 32 - sprintf((char*)ctx_.push(32), "%llu", u);
+}
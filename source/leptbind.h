@@ -0,0 +1,323 @@
+#ifndef LEPT_BIND_H__
+#define LEPT_BIND_H__
+
+#include "leptjson.h"
+#include <string>
+#include <vector>
+#include <type_traits>
+
+/*
+ * Typed binding: parse JSON straight into C++ structs and write them back
+ * without building a lept_value tree.
+ *
+ *     struct point { double x, y; std::string label; std::vector<int> tags; };
+ *     LEPT_BIND(point,
+ *         LEPT_FIELD(point, x),
+ *         LEPT_FIELD(point, y),
+ *         LEPT_FIELD_OPT(point, label),
+ *         LEPT_FIELD_OPT(point, tags))
+ *
+ *     point p;
+ *     int ret = lept_bind_parse("{\"x\":1,\"y\":2}", p);
+ *     std::string json = lept_bind_stringify(p);
+ *
+ * Members may be arithmetic types, bool, std::string, std::vector of a
+ * bindable type, or another struct with a LEPT_BIND table. Unknown keys are
+ * skipped without being decoded. A missing required field fails with
+ * LEPT_PARSE_MISS_FIELD; a LEPT_FIELD_OPT member keeps its value when its key
+ * is missing or null. A JSON value of the wrong type fails with
+ * LEPT_PARSE_TYPE_MISMATCH.
+ */
+
+class LeptBindReader
+{
+  public:
+    explicit LeptBindReader(const char *json);
+
+    void skip_whitespace()                  { LeptJson::lept_parse_whitespace(ctx_); }
+    char peek() const                       { return *ctx_.json; }
+    void next()                             { ctx_.json++; }
+
+    int  read_null();
+    int  read_bool(bool &b);
+    int  read_number(double &d);
+    int  read_number(long long &i);
+    int  read_number(unsigned long long &u);
+    int  read_number(lept_value &v);                // a lazy number pointing into the text
+    int  read_string(std::string &s);
+    int  read_key(const char **k, size_t &klen);    // k is valid until the next read
+    int  skip_value()                       { return LeptJson::lept_skip_value(ctx_); }
+    int  finish();
+
+    bool enter()                            { return depth_++ < LEPT_PARSE_MAX_DEPTH; }
+    void leave()                            { depth_--; }
+
+  private:
+    LeptJson::lept_context ctx_;
+    size_t depth_;
+
+    int  expect_number() const;
+    int  read_integer(const char **text);
+};
+
+class LeptBindWriter
+{
+  public:
+    LeptBindWriter();
+
+    void put(char ch)                       { *(char*)ctx_.push(1) = ch; }
+    void put(const char *s, size_t len)     { memcpy(ctx_.push(len), s, len); }
+    void string(const char *s, size_t len)  { LeptJson::lept_stringify_string(ctx_, s, len); }
+    void number(double d)                   { LeptJson::lept_stringify_number(ctx_, d); }
+    void integer(long long i);
+    void integer(unsigned long long u);
+
+    std::string str() const                 { return std::string(ctx_.stack.get(), ctx_.top); }
+
+  private:
+    LeptJson::lept_context ctx_;
+};
+
+template <typename T>
+struct lept_field
+{
+    const char *key;
+    size_t klen;
+    bool optional;
+    int  (*read)(LeptBindReader &r, T &obj);
+    void (*write)(LeptBindWriter &w, const T &obj);
+};
+
+// specialized for every bound struct by LEPT_BIND
+template <typename T> struct lept_bind;
+
+template <typename T, typename Enable = void> struct lept_bind_value;
+
+template <typename T>
+int lept_bind_read_object(LeptBindReader &r, T &obj)
+{
+    size_t n, next = 0;
+    const lept_field<T> *f = lept_bind<T>::fields(n);
+    unsigned long long seen = 0;   // LEPT_BIND allows at most 64 fields
+    int ret;
+    if (r.peek() != '{')
+        return LEPT_PARSE_TYPE_MISMATCH;
+    if (!r.enter())
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    r.next();
+    r.skip_whitespace();
+    if (r.peek() == '}')
+        r.next();
+    else for (;;) {
+        const char *key;
+        size_t klen, i;
+        if (r.peek() != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = r.read_key(&key, klen)) != LEPT_PARSE_OK)
+            return ret;
+        // members usually come in table order, so try the slot after the last match first
+        for (i = next; i < n + next; ++i)
+            if (f[i % n].klen == klen && memcmp(f[i % n].key, key, klen) == 0)
+                break;
+        r.skip_whitespace();
+        if (r.peek() != ':')
+            return LEPT_PARSE_MISS_COLON;
+        r.next();
+        r.skip_whitespace();
+        if (i == n + next)
+            ret = r.skip_value();
+        else if (f[i % n].optional && r.peek() == 'n')
+            ret = r.read_null();
+        else {
+            ret = f[i % n].read(r, obj);
+            seen |= 1ULL << (i % n);
+            next = (i + 1) % n;
+        }
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        r.skip_whitespace();
+        if (r.peek() == ',') {
+            r.next();
+            r.skip_whitespace();
+        }
+        else if (r.peek() == '}') {
+            r.next();
+            break;
+        }
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+    r.leave();
+    for (size_t i = 0; i < n; ++i)
+        if (!f[i].optional && !(seen & (1ULL << i)))
+            return LEPT_PARSE_MISS_FIELD;
+    return LEPT_PARSE_OK;
+}
+
+template <typename T>
+void lept_bind_write_object(LeptBindWriter &w, const T &obj)
+{
+    size_t n;
+    const lept_field<T> *f = lept_bind<T>::fields(n);
+    w.put('{');
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0)
+            w.put(',');
+        w.string(f[i].key, f[i].klen);
+        w.put(':');
+        f[i].write(w, obj);
+    }
+    w.put('}');
+}
+
+// structs with a LEPT_BIND table
+template <typename T, typename Enable>
+struct lept_bind_value
+{
+    static int  read(LeptBindReader &r, T &v)          { return lept_bind_read_object(r, v); }
+    static void write(LeptBindWriter &w, const T &v)   { lept_bind_write_object(w, v); }
+};
+
+template <typename T>
+struct lept_bind_value<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    // integers are read as long long or unsigned long long, then narrowed
+    typedef typename std::conditional<!std::is_integral<T>::value, double,
+            typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type>::type wide;
+
+    static int read(LeptBindReader &r, T &v)
+    {
+        wide x;
+        int ret;
+        if ((ret = r.read_number(x)) != LEPT_PARSE_OK)
+            return ret;
+        if (std::is_integral<T>::value && x != (wide)(T)x)
+            return LEPT_PARSE_TYPE_MISMATCH; // out of range
+        v = (T)x;
+        return LEPT_PARSE_OK;
+    }
+    static void write(LeptBindWriter &w, const T &v)
+    {
+        if (!std::is_integral<T>::value)
+            w.number((double)v);
+        else if (std::is_signed<T>::value)
+            w.integer((long long)v);
+        else
+            w.integer((unsigned long long)v);
+    }
+};
+
+template <>
+struct lept_bind_value<bool>
+{
+    static int  read(LeptBindReader &r, bool &v)       { return r.read_bool(v); }
+    static void write(LeptBindWriter &w, const bool &v){ v ? w.put("true", 4) : w.put("false", 5); }
+};
+
+template <>
+struct lept_bind_value<std::string>
+{
+    static int  read(LeptBindReader &r, std::string &v)        { return r.read_string(v); }
+    static void write(LeptBindWriter &w, const std::string &v) { w.string(v.data(), v.size()); }
+};
+
+template <typename E>
+struct lept_bind_value<std::vector<E> >
+{
+    static int read(LeptBindReader &r, std::vector<E> &v)
+    {
+        int ret;
+        if (r.peek() != '[')
+            return LEPT_PARSE_TYPE_MISMATCH;
+        if (!r.enter())
+            return LEPT_PARSE_DEPTH_EXCEEDED;
+        r.next();
+        r.skip_whitespace();
+        v.clear();
+        if (r.peek() == ']') {
+            r.next();
+            r.leave();
+            return LEPT_PARSE_OK;
+        }
+        for (;;) {
+            E e = E();
+            if ((ret = lept_bind_value<E>::read(r, e)) != LEPT_PARSE_OK)
+                return ret;
+            v.push_back(std::move(e));
+            r.skip_whitespace();
+            if (r.peek() == ',') {
+                r.next();
+                r.skip_whitespace();
+            }
+            else if (r.peek() == ']') {
+                r.next();
+                r.leave();
+                return LEPT_PARSE_OK;
+            }
+            else
+                return LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+    static void write(LeptBindWriter &w, const std::vector<E> &v)
+    {
+        w.put('[');
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (i > 0)
+                w.put(',');
+            lept_bind_value<E>::write(w, v[i]);
+        }
+        w.put(']');
+    }
+};
+
+template <typename T, typename M, M T::*member>
+int lept_bind_read_member(LeptBindReader &r, T &obj)
+{
+    return lept_bind_value<M>::read(r, obj.*member);
+}
+
+template <typename T, typename M, M T::*member>
+void lept_bind_write_member(LeptBindWriter &w, const T &obj)
+{
+    lept_bind_value<M>::write(w, obj.*member);
+}
+
+#define LEPT_FIELD_KEY(Struct, member, key, optional)                                   \
+    lept_field<Struct>{ key, sizeof(key) - 1, optional,                                 \
+        &lept_bind_read_member<Struct, decltype(Struct::member), &Struct::member>,      \
+        &lept_bind_write_member<Struct, decltype(Struct::member), &Struct::member> }
+#define LEPT_FIELD(Struct, member)      LEPT_FIELD_KEY(Struct, member, #member, false)
+#define LEPT_FIELD_OPT(Struct, member)  LEPT_FIELD_KEY(Struct, member, #member, true)
+
+#define LEPT_BIND(Struct, ...)                                                          \
+    template <> struct lept_bind<Struct> {                                              \
+        static const lept_field<Struct>* fields(size_t &n) {                            \
+            static const lept_field<Struct> f[] = { __VA_ARGS__ };                      \
+            static_assert(sizeof(f) / sizeof(f[0]) <= 64, "at most 64 fields");         \
+            n = sizeof(f) / sizeof(f[0]);                                               \
+            return f;                                                                   \
+        }                                                                               \
+    };
+
+template <typename T>
+int lept_bind_parse(const std::string &json, T &out)
+{
+    LeptBindReader r(json.c_str());
+    int ret;
+    r.skip_whitespace();
+    if (r.peek() == '\0')
+        return LEPT_PARSE_EXPECT_VALUE;
+    if ((ret = lept_bind_value<T>::read(r, out)) != LEPT_PARSE_OK)
+        return ret;
+    return r.finish();
+}
+
+template <typename T>
+std::string lept_bind_stringify(const T &in)
+{
+    LeptBindWriter w;
+    lept_bind_value<T>::write(w, in);
+    return w.str();
+}
+
+#endif
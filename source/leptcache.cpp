@@ -0,0 +1,156 @@
+#include "leptcache.h"
+#include "lepthash.h"
+#include <iterator>
+#include <unordered_set>
+
+// heap bytes held by the tree under v; the keys of a shape are charged to the first object met with it
+static size_t lept_tree_bytes(const lept_value &v)
+{
+    std::vector<const lept_value*> stack(1, &v);
+    std::unordered_set<const lept_shape*> shapes;
+    size_t bytes = 0;
+    while (!stack.empty()) {
+        const lept_value *cur = stack.back();
+        stack.pop_back();
+        if (cur->type == LEPT_STRING || cur->type == LEPT_RAW)
+            bytes += cur->u.s.len + 1;
+        else if (cur->type == LEPT_ARRAY) {
+            bytes += cur->u.a.size * sizeof(lept_value);
+            for (size_t i = 0; i < cur->u.a.size; ++i)
+                stack.push_back(&cur->u.a.e[i]);
+        }
+        else if (cur->type == LEPT_OBJECT && lept_value_get_object_shape(*cur)) {
+            const lept_shape *shape = lept_value_get_object_shape(*cur);
+            bytes += sizeof(lept_shape*) + cur->u.obj.size * sizeof(lept_value);
+            if (shapes.insert(shape).second) {
+                bytes += sizeof(lept_shape) + shape->size * sizeof(lept_key);
+                for (size_t i = 0; i < shape->size; ++i)
+                    bytes += shape->keys[i].klen + 1;
+            }
+            for (size_t i = 0; i < cur->u.obj.size; ++i)
+                stack.push_back(lept_value_get_object_value(*cur, i));
+        }
+        else if (cur->type == LEPT_OBJECT) {
+            bytes += cur->u.obj.size * sizeof(lept_member);
+            for (size_t i = 0; i < cur->u.obj.size; ++i) {
+                bytes += cur->u.obj.m[i].klen + 1;
+                stack.push_back(&cur->u.obj.m[i].v);
+            }
+        }
+    }
+    return bytes;
+}
+
+LeptParseCache::LeptParseCache(size_t max_bytes, size_t max_entries)
+    : max_bytes_(max_bytes), max_entries_(max_entries), bytes_(0), hits_(0), misses_(0)
+{
+}
+
+/*
+ * The cached document for json, or nullptr. Only the length is checked under
+ * the lock; the entry's text is held by reference while its bytes are
+ * compared, so an eviction in between cannot free it.
+ */
+std::shared_ptr<const LeptJson> LeptParseCache::find(uint64_t hash, const std::string &json, bool count)
+{
+    std::shared_ptr<const std::string> text;
+    std::shared_ptr<const LeptJson> doc;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(hash);
+        if (it == index_.end() || it->second->json->size() != json.size()) {
+            if (count)
+                misses_++;
+            return nullptr;
+        }
+        text = it->second->json;
+        doc = it->second->doc;
+    }
+    bool hit = (*text == json);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (hit) {
+        auto it = index_.find(hash);
+        if (it != index_.end() && it->second->json == text)
+            lru_.splice(lru_.begin(), lru_, it->second);
+    }
+    if (count)
+        (hit ? hits_ : misses_)++;
+    return hit ? doc : nullptr;
+}
+
+/*
+ * The parse itself runs outside the lock, so misses on different payloads do
+ * not wait for each other; when two callers miss on the same payload, the
+ * first document inserted is returned to both.
+ */
+std::shared_ptr<const LeptJson> LeptParseCache::parse(const std::string &json, int *ret)
+{
+    uint64_t hash = lept_hash_bytes(json.data(), json.size());
+    std::shared_ptr<const LeptJson> cached = find(hash, json, true);
+    if (cached) {
+        if (ret) *ret = LEPT_PARSE_OK;
+        return cached;
+    }
+
+    std::shared_ptr<LeptJson> doc = std::make_shared<LeptJson>();
+    int r = doc->parse(json);
+    if (ret) *ret = r;
+    if (r != LEPT_PARSE_OK)
+        return nullptr;
+    size_t bytes = sizeof(entry) + json.size() + lept_tree_bytes(doc->get_value());
+    if (bytes > max_bytes_ || max_entries_ == 0)
+        return doc;
+    if ((cached = find(hash, json, false)) != nullptr)
+        return cached;  // another caller inserted it while this one parsed
+
+    std::shared_ptr<const std::string> text = std::make_shared<const std::string>(json);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hash);
+    if (it != index_.end())
+        evict(it->second); // a hash collision, or a racing insert of the same payload: the newer wins
+    while (!lru_.empty() && (bytes_ + bytes > max_bytes_ || lru_.size() >= max_entries_))
+        evict(std::prev(lru_.end()));
+    lru_.push_front(entry{hash, std::move(text), doc, bytes});
+    index_[hash] = lru_.begin();
+    bytes_ += bytes;
+    return doc;
+}
+
+void LeptParseCache::evict(entry_iter it)
+{
+    bytes_ -= it->bytes;
+    index_.erase(it->hash);
+    lru_.erase(it);
+}
+
+void LeptParseCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+size_t LeptParseCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+size_t LeptParseCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+size_t LeptParseCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+size_t LeptParseCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
@@ -0,0 +1,62 @@
+#ifndef LEPT_CACHE_H__
+#define LEPT_CACHE_H__
+
+#include "leptjson.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#ifndef LEPT_PARSE_CACHE_MAX_BYTES
+#define LEPT_PARSE_CACHE_MAX_BYTES (64 << 20)
+#endif
+
+#ifndef LEPT_PARSE_CACHE_MAX_ENTRIES
+#define LEPT_PARSE_CACHE_MAX_ENTRIES 4096
+#endif
+
+/*
+ * Thread-safe LRU cache of parsed documents keyed by the input bytes.
+ * A lookup hashes the input and confirms a hit by comparing the length and
+ * bytes with the stored copy, so a repeated payload costs a hash and a memcmp
+ * instead of a parse. The memcmp runs outside the lock, on a reference to the
+ * copy, so hits on large payloads do not hold up other callers. Documents are shared read-only between callers and stay
+ * alive while any caller holds them, even after they are evicted.
+ *
+ * Each entry is charged for its input copy and its value tree; the least
+ * recently used entries are evicted to stay within both limits. Inputs that
+ * fail to parse are not cached.
+ */
+class LeptParseCache
+{
+  public:
+    explicit LeptParseCache(size_t max_bytes = LEPT_PARSE_CACHE_MAX_BYTES,
+                            size_t max_entries = LEPT_PARSE_CACHE_MAX_ENTRIES);
+
+    // the parsed document, or nullptr with the error in *ret
+    std::shared_ptr<const LeptJson> parse(const std::string &json, int *ret = nullptr);
+
+    void   clear();
+    size_t size() const;
+    size_t bytes() const;
+    size_t hits() const;
+    size_t misses() const;
+
+  private:
+    struct entry {
+        uint64_t hash;
+        std::shared_ptr<const std::string> json;
+        std::shared_ptr<const LeptJson> doc;
+        size_t bytes;
+    };
+    typedef std::list<entry>::iterator entry_iter;
+
+    std::list<entry> lru_;     // most recently used first
+    std::unordered_map<uint64_t, entry_iter> index_;
+    size_t max_bytes_, max_entries_, bytes_, hits_, misses_;
+    mutable std::mutex mutex_;
+
+    void evict(entry_iter it);
+    std::shared_ptr<const LeptJson> find(uint64_t hash, const std::string &json, bool count);
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "leptcolumns.h"
+#include "leptbind.h"
+
+// the values a column of type t holds for rows it had no value in, before it got its type
+static void lept_column_start(lept_column &c, lept_column_type t, size_t rows)
+{
+    c.type = t;
+    switch (t) {
+        case LEPT_COLUMN_BOOLEAN:
+        case LEPT_COLUMN_INT64:  c.i64.assign(rows, 0); break;
+        case LEPT_COLUMN_DOUBLE: c.f64.assign(rows, 0); break;
+        case LEPT_COLUMN_STRING: c.offsets.assign(rows + 1, 0); break;
+        default: break;
+    }
+}
+
+void LeptColumns::clear()
+{
+    columns_.clear();
+    index_.clear();
+    rows_ = 0;
+}
+
+const lept_column* LeptColumns::find(const char *name, size_t len) const
+{
+    auto it = index_.find(std::string(name, len));
+    return it == index_.end() ? nullptr : &columns_[it->second];
+}
+
+// records usually list their keys in the same order, so the column after the last one is tried first
+lept_column& LeptColumns::column_for(const char *key, size_t klen, size_t &hint)
+{
+    size_t i = hint;
+    if (i >= columns_.size() || columns_[i].name.size() != klen || memcmp(columns_[i].name.data(), key, klen) != 0) {
+        auto it = index_.find(std::string(key, klen));
+        if (it != index_.end())
+            i = it->second;
+        else {
+            i = columns_.size();
+            columns_.push_back(lept_column());
+            lept_column &c = columns_.back();
+            c.name.assign(key, klen);
+            c.type = LEPT_COLUMN_NULL;
+            c.valid.assign((rows_ >> 6) + 1, 0);
+            c.last_row = c.key_row = (size_t)-1;
+            index_.emplace(c.name, i);
+        }
+    }
+    hint = i + 1;
+    return columns_[i];
+}
+
+int LeptColumns::put_boolean(lept_column &c, bool b)
+{
+    if (c.type == LEPT_COLUMN_NULL)
+        lept_column_start(c, LEPT_COLUMN_BOOLEAN, rows_);
+    if (c.type != LEPT_COLUMN_BOOLEAN)
+        return LEPT_PARSE_TYPE_MISMATCH;
+    c.i64.push_back(b);
+    c.valid[rows_ >> 6] |= 1ULL << (rows_ & 63);
+    c.last_row = rows_;
+    return LEPT_PARSE_OK;
+}
+
+int LeptColumns::put_number(lept_column &c, double d, bool whole, int64_t i)
+{
+    if (c.type == LEPT_COLUMN_NULL)
+        lept_column_start(c, whole ? LEPT_COLUMN_INT64 : LEPT_COLUMN_DOUBLE, rows_);
+    else if (c.type == LEPT_COLUMN_INT64 && !whole) {
+        c.f64.assign(c.i64.begin(), c.i64.end());
+        std::vector<int64_t>().swap(c.i64);
+        c.type = LEPT_COLUMN_DOUBLE;
+    }
+    if (c.type == LEPT_COLUMN_INT64)
+        c.i64.push_back(i);
+    else if (c.type == LEPT_COLUMN_DOUBLE)
+        c.f64.push_back(d);
+    else
+        return LEPT_PARSE_TYPE_MISMATCH;
+    c.valid[rows_ >> 6] |= 1ULL << (rows_ & 63);
+    c.last_row = rows_;
+    return LEPT_PARSE_OK;
+}
+
+int LeptColumns::put_string(lept_column &c, const char *s, size_t len)
+{
+    if (c.type == LEPT_COLUMN_NULL)
+        lept_column_start(c, LEPT_COLUMN_STRING, rows_);
+    if (c.type != LEPT_COLUMN_STRING)
+        return LEPT_PARSE_TYPE_MISMATCH;
+    c.bytes.append(s, len);
+    c.offsets.push_back(c.bytes.size());
+    c.valid[rows_ >> 6] |= 1ULL << (rows_ & 63);
+    c.last_row = rows_;
+    return LEPT_PARSE_OK;
+}
+
+// fills the columns the row had no value for, so every column stays one entry per row
+void LeptColumns::end_row()
+{
+    for (auto &c : columns_) {
+        if (c.last_row != rows_) {
+            switch (c.type) {
+                case LEPT_COLUMN_BOOLEAN:
+                case LEPT_COLUMN_INT64:  c.i64.push_back(0); break;
+                case LEPT_COLUMN_DOUBLE: c.f64.push_back(0); break;
+                case LEPT_COLUMN_STRING: c.offsets.push_back(c.bytes.size()); break;
+                default: break;
+            }
+        }
+        if (((rows_ + 1) & 63) == 0)
+            c.valid.push_back(0);
+    }
+    ++rows_;
+}
+
+int LeptColumns::parse_row(LeptBindReader &r)
+{
+    size_t hint = 0;
+    int ret;
+    if (r.peek() != '{')
+        return r.peek() == '\0' ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_TYPE_MISMATCH;
+    r.next();
+    r.skip_whitespace();
+    if (r.peek() == '}') {
+        r.next();
+        end_row();
+        return LEPT_PARSE_OK;
+    }
+    for (;;) {
+        const char *key;
+        size_t klen;
+        if (r.peek() != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = r.read_key(&key, klen)) != LEPT_PARSE_OK)
+            return ret;
+        // the key only lives until the next read, so its column is looked up first
+        lept_column &c = column_for(key, klen, hint);
+        r.skip_whitespace();
+        if (r.peek() != ':')
+            return LEPT_PARSE_MISS_COLON;
+        r.next();
+        r.skip_whitespace();
+        if (c.key_row == rows_)
+            ret = r.skip_value();   // a repeated key
+        else {
+            c.key_row = rows_;
+            switch (r.peek()) {
+                case 'n':
+                    ret = r.read_null();
+                    break;
+                case 't': case 'f': {
+                    bool b;
+                    if ((ret = r.read_bool(b)) == LEPT_PARSE_OK)
+                        ret = put_boolean(c, b);
+                    break;
+                }
+                case '\"': {
+                    const char *s;
+                    size_t len;
+                    // read_key() decodes any string onto the reader's scratch stack
+                    if ((ret = r.read_key(&s, len)) == LEPT_PARSE_OK)
+                        ret = put_string(c, s, len);
+                    break;
+                }
+                case '[': case '{':
+                    return LEPT_PARSE_TYPE_MISMATCH;
+                default: {
+                    lept_value v{};
+                    int64_t i;
+                    // a lazy number keeps its text, so whole numbers are read exactly, as convert() reads them
+                    if ((ret = r.read_number(v)) == LEPT_PARSE_OK) {
+                        bool whole = lept_value_get_int64(v, i);
+                        ret = put_number(c, whole ? (double)i : lept_value_get_number(v), whole, i);
+                    }
+                }
+            }
+        }
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        r.skip_whitespace();
+        if (r.peek() == ',') {
+            r.next();
+            r.skip_whitespace();
+        }
+        else if (r.peek() == '}') {
+            r.next();
+            end_row();
+            return LEPT_PARSE_OK;
+        }
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+int LeptColumns::parse(const std::string &json)
+{
+    LeptBindReader r(json.c_str());
+    int ret = LEPT_PARSE_OK;
+    clear();
+    r.skip_whitespace();
+    if (r.peek() != '[')
+        return r.peek() == '\0' ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_TYPE_MISMATCH;
+    r.next();
+    r.skip_whitespace();
+    if (r.peek() == ']')
+        r.next();
+    else for (;;) {
+        if ((ret = parse_row(r)) != LEPT_PARSE_OK)
+            break;
+        r.skip_whitespace();
+        if (r.peek() == ',') {
+            r.next();
+            r.skip_whitespace();
+        }
+        else if (r.peek() == ']') {
+            r.next();
+            break;
+        }
+        else {
+            ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+    if (ret == LEPT_PARSE_OK)
+        ret = r.finish();
+    if (ret != LEPT_PARSE_OK)
+        clear();
+    return ret;
+}
+
+int LeptColumns::convert(const lept_value &v)
+{
+    int ret = LEPT_PARSE_OK;
+    clear();
+    if (v.type != LEPT_ARRAY)
+        return LEPT_PARSE_TYPE_MISMATCH;
+    for (size_t row = 0; row < v.u.a.size && ret == LEPT_PARSE_OK; ++row) {
+        const lept_value &e = v.u.a.e[row];
+        size_t hint = 0;
+        if (e.type != LEPT_OBJECT) {
+            ret = LEPT_PARSE_TYPE_MISMATCH;
+            break;
+        }
+        for (size_t j = 0; j < e.u.obj.size && ret == LEPT_PARSE_OK; ++j) {
+            const lept_value &mv = *lept_value_get_object_value(e, j);
+            lept_column &c = column_for(lept_value_get_object_key(e, j), lept_value_get_object_key_length(e, j), hint);
+            if (c.key_row == rows_)
+                continue;   // a repeated key
+            c.key_row = rows_;
+            switch (mv.type) {
+                case LEPT_NULL: break;
+                case LEPT_TRUE:
+                case LEPT_FALSE: ret = put_boolean(c, mv.type == LEPT_TRUE); break;
+                case LEPT_STRING: ret = put_string(c, mv.u.s.s, mv.u.s.len); break;
+                case LEPT_NUMBER: {
+                    int64_t i;
+                    bool whole = lept_value_get_int64(mv, i);
+                    ret = put_number(c, whole ? (double)i : lept_value_get_number(mv), whole, i);
+                    break;
+                }
+                default: ret = LEPT_PARSE_TYPE_MISMATCH;
+            }
+        }
+        if (ret == LEPT_PARSE_OK)
+            end_row();
+    }
+    if (ret != LEPT_PARSE_OK)
+        clear();
+    return ret;
+}
@@ -0,0 +1,82 @@
+#ifndef LEPT_COLUMNS_H__
+#define LEPT_COLUMNS_H__
+
+#include "leptjson.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class LeptBindReader;
+
+enum lept_column_type
+{
+    LEPT_COLUMN_NULL,       // only nulls or missing so far: no values stored
+    LEPT_COLUMN_BOOLEAN,
+    LEPT_COLUMN_INT64,
+    LEPT_COLUMN_DOUBLE,
+    LEPT_COLUMN_STRING
+};
+
+// one field across all rows; rows without a value hold 0 (or an empty string) and a clear valid bit
+struct lept_column
+{
+    std::string name;
+    lept_column_type type;
+    std::vector<uint64_t> valid;    // bit i % 64 of word i / 64 is set when row i has a value
+    std::vector<int64_t> i64;       // INT64, and BOOLEAN as 0 or 1
+    std::vector<double> f64;        // DOUBLE
+    std::vector<size_t> offsets;    // STRING: row i is bytes[offsets[i], offsets[i + 1])
+    std::string bytes;
+    size_t last_row;                // the row that last set a value
+    size_t key_row;                 // the row that last had the key, null or not
+
+    bool is_valid(size_t row) const { return (valid[row >> 6] >> (row & 63)) & 1; }
+};
+
+/*
+ * An array of objects laid out as columns, one per member key.
+ *
+ *     LeptColumns c;
+ *     int ret = c.parse("[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"score\":0.5}]");
+ *     const lept_column *id = c.find("id", 2);    // id->i64 is {1, 2}
+ *
+ * parse() reads the text straight into the columns without building a tree;
+ * convert() does the same from a parsed array. A number column stays int64
+ * while every value is whole and fits, and turns into double at the first
+ * one that does not. A key that appears late gets null for the rows before.
+ *
+ * The root must be an array of objects whose member values are scalars; an
+ * array or object member, or a key whose values change type (other than
+ * int64 to double), fails with LEPT_PARSE_TYPE_MISMATCH and leaves no
+ * columns. When a key repeats within an object, its first value is kept, even
+ * a null.
+ */
+class LeptColumns
+{
+  public:
+    LeptColumns() : rows_(0) {}
+
+    int parse(const std::string &json);
+    int convert(const lept_value &v);
+    void clear();
+
+    size_t rows() const                         { return rows_; }
+    size_t size() const                         { return columns_.size(); }
+    const lept_column& column(size_t i) const   { assert(i < columns_.size()); return columns_[i]; }
+    // the column for `name`, or nullptr
+    const lept_column* find(const char *name, size_t len) const;
+
+  private:
+    std::vector<lept_column> columns_;
+    std::unordered_map<std::string, size_t> index_;
+    size_t rows_;
+
+    lept_column& column_for(const char *key, size_t klen, size_t &hint);
+    int put_boolean(lept_column &c, bool b);
+    int put_number(lept_column &c, double d, bool whole, int64_t i);
+    int put_string(lept_column &c, const char *s, size_t len);
+    int parse_row(LeptBindReader &r);
+    void end_row();
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "leptextract.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+// a block of the input, consumed one char at a time; consumed chars are copied to `rec` while it is set
+struct LeptExtractor::reader
+{
+    int fd;
+    std::unique_ptr<char[]> buf;
+    size_t size, pos, len;
+    bool eof, failed, overflow;
+    std::string *rec;
+    size_t limit;
+
+    reader(int fd, size_t size, size_t limit)
+        : fd(fd), buf(new char[size]), size(size), pos(0), len(0),
+          eof(false), failed(false), overflow(false), rec(nullptr), limit(limit) {}
+
+    bool fill()
+    {
+        while (!eof && !failed) {
+            ssize_t n = ::read(fd, buf.get(), size);
+            if (n > 0) {
+                pos = 0;
+                len = (size_t)n;
+                return true;
+            }
+            if (n == 0)
+                eof = true;
+            else if (errno != EINTR)
+                failed = true;
+        }
+        return false;
+    }
+    // the next char, or -1 at the end of the input
+    int peek()
+    {
+        if (pos == len && !fill())
+            return -1;
+        return (unsigned char)buf[pos];
+    }
+    void next()
+    {
+        if (rec) {
+            rec->push_back(buf[pos]);
+            overflow = overflow || rec->size() > limit;
+        }
+        ++pos;
+    }
+    void skip_whitespace()
+    {
+        for (int ch; (ch = peek()) == ' ' || ch == '\t' || ch == '\n' || ch == '\r'; )
+            next();
+    }
+    int end_error(int ret) const
+    {
+        return failed ? LEPT_PARSE_IO_ERROR : ret;
+    }
+};
+
+// the same structural skip as LeptJson::lept_skip_value, over a reader
+int LeptExtractor::skip_value(reader &r)
+{
+    size_t depth = 0;
+    unsigned long long objects[LEPT_PARSE_MAX_DEPTH / 64 + 1]; // bit per open bracket: set for '{'
+    int ch = r.peek();
+    if (ch < 0)
+        return r.end_error(LEPT_PARSE_EXPECT_VALUE);
+    do {
+        if (r.overflow)
+            return LEPT_PARSE_VALUE_TOO_LARGE;
+        switch (ch = r.peek()) {
+            case -1:
+                return r.end_error(LEPT_PARSE_INVALID_VALUE); // unbalanced container
+            case '\"':
+                for (r.next(); (ch = r.peek()) != '\"'; ) {
+                    if (ch < 0)
+                        return r.end_error(LEPT_PARSE_MISS_QUOTATION_MARK);
+                    r.next();
+                    if (ch == '\\' && r.peek() >= 0)
+                        r.next();
+                    if (r.overflow)
+                        return LEPT_PARSE_VALUE_TOO_LARGE;
+                }
+                r.next();
+                break;
+            case '[': case '{':
+                if (depth == LEPT_PARSE_MAX_DEPTH)
+                    return LEPT_PARSE_DEPTH_EXCEEDED;
+                if (ch == '{')
+                    objects[depth / 64] |= 1ULL << (depth % 64);
+                else
+                    objects[depth / 64] &= ~(1ULL << (depth % 64));
+                ++depth; r.next();
+                break;
+            case ']': case '}':
+                if (depth == 0)
+                    return LEPT_PARSE_INVALID_VALUE;
+                --depth;
+                if (((objects[depth / 64] >> (depth % 64)) & 1) != (ch == '}'))
+                    return ch == '}' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                r.next();
+                break;
+            default:
+                if (depth > 0) {
+                    r.next();
+                    break;
+                }
+                // a literal or a number at the top: runs until the next delimiter
+                size_t n = 0;
+                for (; ch >= 0 && ch != ',' && ch != ']' && ch != '}' && ch != ':' &&
+                       ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n'; ch = r.peek(), ++n)
+                    r.next();
+                if (n == 0)
+                    return LEPT_PARSE_INVALID_VALUE;
+        }
+    } while (depth > 0);
+    return r.overflow ? LEPT_PARSE_VALUE_TOO_LARGE : LEPT_PARSE_OK;
+}
+
+// reads a member key and its colon; escaped keys are decoded by the parser
+int LeptExtractor::read_key(reader &r, std::string &key, size_t limit)
+{
+    bool escaped = false;
+    int ch;
+    if (r.peek() != '\"')
+        return r.end_error(LEPT_PARSE_MISS_KEY);
+    r.next();
+    key.assign(1, '\"');
+    while ((ch = r.peek()) != '\"') {
+        if (ch < 0)
+            return r.end_error(LEPT_PARSE_MISS_QUOTATION_MARK);
+        key.push_back((char)ch);
+        r.next();
+        if (ch == '\\' && (ch = r.peek()) >= 0) {
+            key.push_back((char)ch);
+            r.next();
+            escaped = true;
+        }
+        if (key.size() > limit)
+            return LEPT_PARSE_VALUE_TOO_LARGE;
+    }
+    r.next();
+    if (escaped) {
+        key.push_back('\"');
+        LeptJson s;
+        int ret = s.parse(key);
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        key.assign(s.get_string(), s.get_string_length());
+    }
+    else
+        key.erase(0, 1);
+    r.skip_whitespace();
+    if (r.peek() != ':')
+        return r.end_error(LEPT_PARSE_MISS_COLON);
+    r.next();
+    r.skip_whitespace();
+    return LEPT_PARSE_OK;
+}
+
+LeptExtractor::LeptExtractor(size_t block_size, size_t max_value_size)
+    : block_size_(block_size > 0 ? block_size : 1), max_value_size_(max_value_size)
+{
+}
+
+int LeptExtractor::add(const std::string &pattern)
+{
+    std::vector<segment> segs;
+    size_t i = 0, n = pattern.size();
+    if (patterns_.size() >= 64)
+        return -1;
+    while (i < n) {
+        segment seg;
+        seg.index = 0;
+        if (pattern[i] == '[') {
+            size_t close = pattern.find(']', i);
+            if (close == std::string::npos || close == i + 1)
+                return -1;
+            std::string inner = pattern.substr(i + 1, close - i - 1);
+            if (inner == "*")
+                seg.kind = LEPT_SEGMENT_ANY_INDEX;
+            else if (inner.find_first_not_of("0123456789") == std::string::npos) {
+                seg.kind = LEPT_SEGMENT_INDEX;
+                seg.index = (size_t)strtoull(inner.c_str(), nullptr, 10);
+            }
+            else
+                return -1;
+            i = close + 1;
+        }
+        else {
+            if (pattern[i] == '.')
+                ++i;
+            else if (i != 0)
+                return -1;
+            size_t end = pattern.find_first_of(".[", i);
+            if (end == std::string::npos)
+                end = n;
+            if (end == i)
+                return -1;
+            seg.key = pattern.substr(i, end - i);
+            seg.kind = (seg.key == "*" ? LEPT_SEGMENT_ANY_KEY : LEPT_SEGMENT_KEY);
+            i = end;
+        }
+        segs.push_back(seg);
+    }
+    patterns_.push_back(segs);
+    return (int)patterns_.size() - 1;
+}
+
+// the patterns of `alive` whose segment at `depth` accepts the member `key` (or element `index` when key is null)
+uint64_t LeptExtractor::match(uint64_t alive, size_t depth, const std::string *key, size_t index) const
+{
+    uint64_t child = 0;
+    for (size_t p = 0; p < patterns_.size(); ++p) {
+        if (!(alive & (1ULL << p)))
+            continue;
+        const segment &seg = patterns_[p][depth];
+        bool ok = key ? (seg.kind == LEPT_SEGMENT_ANY_KEY || (seg.kind == LEPT_SEGMENT_KEY && seg.key == *key))
+                      : (seg.kind == LEPT_SEGMENT_ANY_INDEX || (seg.kind == LEPT_SEGMENT_INDEX && seg.index == index));
+        if (ok)
+            child |= 1ULL << p;
+    }
+    return child;
+}
+
+// gets ready to read the next element or member of a container at `depth`
+int LeptExtractor::next_child(reader &r, bool array, size_t index, uint64_t alive, size_t depth,
+                              std::string &key, uint64_t &child) const
+{
+    if (array) {
+        child = match(alive, depth, nullptr, index);
+        return LEPT_PARSE_OK;
+    }
+    int ret = read_key(r, key, max_value_size_);
+    if (ret == LEPT_PARSE_OK)
+        child = match(alive, depth, &key, 0);
+    return ret;
+}
+
+int LeptExtractor::extract(const char *path, const callback &cb) const
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return LEPT_PARSE_IO_ERROR;
+    int ret = extract(fd, cb);
+    ::close(fd);
+    return ret;
+}
+
+/*
+ * The walk keeps one frame per open container that some pattern can still
+ * reach, with the patterns that matched the path so far as a bit mask. A value
+ * is captured when a pattern ends at it: from its first char on, everything
+ * read is copied into `text` until the value ends, so captures of values
+ * nested in one another share the same text.
+ */
+int LeptExtractor::extract(int fd, const callback &cb) const
+{
+    struct capture { size_t start; uint64_t patterns; };
+    struct frame { bool array; size_t index; uint64_t alive; bool captured; };
+    std::vector<frame> stack;
+    std::vector<capture> caps;
+    std::string text, key;
+    reader r(fd, block_size_, max_value_size_);
+    uint64_t alive = (patterns_.size() == 64 ? ~0ULL : (1ULL << patterns_.size()) - 1);
+    int ret;
+
+    // parses the innermost capture and hands it to the callback
+    auto finish = [&]() -> int {
+        capture c = caps.back();
+        caps.pop_back();
+        LeptJson v;
+        int ret = v.parse(text.substr(c.start));
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        for (size_t p = 0; p < patterns_.size(); ++p)
+            if (c.patterns & (1ULL << p))
+                cb(p, v.get_value());
+        if (caps.empty()) {
+            r.rec = nullptr;
+            text.clear();
+        }
+        return LEPT_PARSE_OK;
+    };
+
+    r.skip_whitespace();
+    for (;;) {
+        size_t depth = stack.size();
+        uint64_t done = 0, more = 0;
+        for (size_t p = 0; p < patterns_.size(); ++p)
+            if (alive & (1ULL << p))
+                (patterns_[p].size() == depth ? done : more) |= 1ULL << p;
+        if (done) {
+            caps.push_back(capture{text.size(), done});
+            r.rec = &text;
+        }
+
+        int ch = r.peek();
+        if ((ch == '[' || ch == '{') && more) {
+            if (depth >= LEPT_PARSE_MAX_DEPTH)
+                return LEPT_PARSE_DEPTH_EXCEEDED;
+            r.next();
+            stack.push_back(frame{ch == '[', 0, more, done != 0});
+            r.skip_whitespace();
+            if (r.peek() != (ch == '[' ? ']' : '}')) {
+                if ((ret = next_child(r, ch == '[', 0, more, depth, key, alive)) != LEPT_PARSE_OK)
+                    return ret;
+                continue; // go on with the first child
+            }
+            r.next(); // empty container
+            stack.pop_back();
+        }
+        else if ((ret = skip_value(r)) != LEPT_PARSE_OK)
+            return ret;
+        if (done && (ret = finish()) != LEPT_PARSE_OK)
+            return ret;
+
+        // the value is complete: move on to its next sibling, closing finished containers
+        for (;;) {
+            if (r.overflow)
+                return LEPT_PARSE_VALUE_TOO_LARGE;
+            r.skip_whitespace();
+            if (stack.empty()) {
+                if (r.peek() >= 0)
+                    return LEPT_PARSE_ROOT_NOT_SINGULAR;
+                return r.end_error(LEPT_PARSE_OK);
+            }
+            frame &f = stack.back();
+            ch = r.peek();
+            if (ch == ',') {
+                r.next();
+                r.skip_whitespace();
+                if ((ret = next_child(r, f.array, ++f.index, f.alive, stack.size() - 1, key, alive)) != LEPT_PARSE_OK)
+                    return ret;
+                break;
+            }
+            if (ch != (f.array ? ']' : '}'))
+                return r.end_error(f.array ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                                           : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+            r.next();
+            bool captured = f.captured;
+            stack.pop_back();
+            if (captured && (ret = finish()) != LEPT_PARSE_OK)
+                return ret;
+        }
+    }
+}
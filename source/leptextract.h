@@ -0,0 +1,67 @@
+#ifndef LEPT_EXTRACT_H__
+#define LEPT_EXTRACT_H__
+
+#include "leptjson.h"
+#include <functional>
+
+#ifndef LEPT_EXTRACT_BLOCK_SIZE
+#define LEPT_EXTRACT_BLOCK_SIZE (64 << 10)
+#endif
+
+#ifndef LEPT_EXTRACT_MAX_VALUE_SIZE
+#define LEPT_EXTRACT_MAX_VALUE_SIZE (1 << 20)
+#endif
+
+/*
+ * Pulls the values at a set of paths out of a JSON file without loading it.
+ *
+ *     LeptExtractor x;
+ *     x.add("items[*].id");
+ *     x.extract("big.json", [](size_t pattern, const lept_value &v) { ... });
+ *
+ * A pattern is a sequence of `.key` (the leading dot may be left out), `.*`
+ * (any key), `[n]` (element n) and `[*]` (any element); the empty pattern is
+ * the root. The file is read in blocks of a fixed size and walked without
+ * building anything: subtrees no pattern can reach are skipped by a bracket-
+ * and string-aware scan. Only the text of a matched value is kept; it is
+ * parsed and handed to the callback, and the value is freed when the callback
+ * returns. Memory therefore stays within the block, the nesting stack and the
+ * largest matched value, which must not exceed max_value_size.
+ *
+ * Skipped text is checked for structure only; matched values are validated
+ * by the parser.
+ */
+class LeptExtractor
+{
+  public:
+    typedef std::function<void (size_t pattern, const lept_value &v)> callback;
+
+    explicit LeptExtractor(size_t block_size = LEPT_EXTRACT_BLOCK_SIZE,
+                           size_t max_value_size = LEPT_EXTRACT_MAX_VALUE_SIZE);
+
+    // index of the new pattern, or -1 when it is malformed or there are 64 already
+    int add(const std::string &pattern);
+
+    int extract(const char *path, const callback &cb) const;
+    int extract(int fd, const callback &cb) const;
+
+  private:
+    enum segment_kind { LEPT_SEGMENT_KEY, LEPT_SEGMENT_ANY_KEY, LEPT_SEGMENT_INDEX, LEPT_SEGMENT_ANY_INDEX };
+    struct segment {
+        segment_kind kind;
+        std::string key;
+        size_t index;
+    };
+    struct reader;
+
+    std::vector<std::vector<segment> > patterns_;
+    size_t block_size_, max_value_size_;
+
+    static int skip_value(reader &r);
+    static int read_key(reader &r, std::string &key, size_t limit);
+    uint64_t match(uint64_t alive, size_t depth, const std::string *key, size_t index) const;
+    int next_child(reader &r, bool array, size_t index, uint64_t alive, size_t depth,
+                   std::string &key, uint64_t &child) const;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "lepthash.h"
+#include <algorithm>
+
+#define LEPT_HASH_K 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t lept_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t lept_hash_bytes(const char *s, size_t len, uint64_t seed)
+{
+    uint64_t h = seed ^ (len * LEPT_HASH_K), w;
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ lept_mix(w)) * LEPT_HASH_K;
+    }
+    w = 0;
+    if (len > 0)
+        memcpy(&w, s, len);
+    return lept_mix(h ^ lept_mix(w ^ len));
+}
+
+static inline size_t lept_child_count(const lept_value &v)
+{
+    return v.type == LEPT_ARRAY ? v.u.a.size : v.type == LEPT_OBJECT ? v.u.obj.size : 0;
+}
+
+static inline const lept_value& lept_child(const lept_value &v, size_t i)
+{
+    return v.type == LEPT_ARRAY ? v.u.a.e[i] : *lept_value_get_object_value(v, i);
+}
+
+static uint64_t lept_hash_value(const lept_value &v, std::unordered_map<const lept_value*, uint64_t> *cache);
+
+// a raw value hashes as the tree its text stands for; text that does not parse hashes as bytes
+static uint64_t lept_hash_raw(const lept_value &v)
+{
+    LeptJson doc;
+    if (doc.parse(std::string(v.u.s.s, v.u.s.len)) != LEPT_PARSE_OK)
+        return lept_hash_bytes(v.u.s.s, v.u.s.len, LEPT_RAW);
+    return lept_hash_value(doc.get_value(), nullptr);
+}
+
+/*
+ * Post-order walk with an explicit stack. Array elements are chained in order;
+ * object members are hashed with their key and summed, which does not depend
+ * on their order. Containers found in the cache are not entered.
+ */
+static uint64_t lept_hash_value(const lept_value &v, std::unordered_map<const lept_value*, uint64_t> *cache)
+{
+    struct frame { const lept_value *v; size_t i; uint64_t acc; };
+    std::vector<frame> stack;
+    const lept_value *cur = &v;
+    for (;;) {
+        uint64_t h;
+        std::unordered_map<const lept_value*, uint64_t>::const_iterator it;
+        size_t size = lept_child_count(*cur);
+        if (size > 0 && cache && (it = cache->find(cur)) != cache->end())
+            h = it->second;
+        else if (size > 0) {
+            stack.push_back(frame{cur, 0, (uint64_t)cur->type * LEPT_HASH_K});
+            cur = &lept_child(*cur, 0);
+            continue;
+        }
+        else if (cur->type == LEPT_NUMBER) {
+            double d = lept_value_get_number(*cur);
+            if (d == 0)
+                d = 0.0; // -0 == 0
+            memcpy(&h, &d, sizeof(h));
+            h = lept_mix(h ^ LEPT_NUMBER);
+        }
+        else if (cur->type == LEPT_STRING)
+            h = lept_hash_bytes(cur->u.s.s, cur->u.s.len, LEPT_STRING);
+        else if (cur->type == LEPT_RAW)
+            h = lept_hash_raw(*cur);
+        else
+            h = lept_mix(cur->type); // literal or empty container
+
+        // hand h to the parent, finishing every container it completes
+        for (;;) {
+            if (stack.empty())
+                return h;
+            frame &f = stack.back();
+            if (f.v->type == LEPT_ARRAY)
+                f.acc = lept_mix(f.acc ^ h) + LEPT_HASH_K;
+            else {
+                f.acc += lept_mix(h ^ lept_hash_bytes(lept_value_get_object_key(*f.v, f.i),
+                                                      lept_value_get_object_key_length(*f.v, f.i)));
+            }
+            size = lept_child_count(*f.v);
+            if (++f.i < size) {
+                cur = &lept_child(*f.v, f.i);
+                break;
+            }
+            h = lept_mix(f.acc ^ (size * LEPT_HASH_K));
+            if (cache)
+                (*cache)[f.v] = h;
+            stack.pop_back();
+        }
+    }
+}
+
+// orders the key of member i of object a against the key of member j of object b
+static inline int lept_key_compare(const lept_value &a, size_t i, const lept_value &b, size_t j)
+{
+    size_t alen = lept_value_get_object_key_length(a, i), blen = lept_value_get_object_key_length(b, j);
+    int c = memcmp(lept_value_get_object_key(a, i), lept_value_get_object_key(b, j), std::min(alen, blen));
+    return c != 0 ? c : (alen < blen ? -1 : alen > blen);
+}
+
+static bool lept_equal_value(const lept_value &a, const lept_value &b, LeptHashCache *cache);
+
+/*
+ * Raw values are compared as the trees their text stands for, without the
+ * cache: its entries are keyed by address, and these trees are temporary.
+ * Text that does not parse only equals the same text.
+ */
+static bool lept_equal_raw(const lept_value &a, const lept_value &b)
+{
+    LeptJson x, y;
+    if (a.type == LEPT_RAW && b.type == LEPT_RAW && a.u.s.len == b.u.s.len && memcmp(a.u.s.s, b.u.s.s, a.u.s.len) == 0)
+        return true;
+    if ((a.type == LEPT_RAW && x.parse(std::string(a.u.s.s, a.u.s.len)) != LEPT_PARSE_OK) ||
+        (b.type == LEPT_RAW && y.parse(std::string(b.u.s.s, b.u.s.len)) != LEPT_PARSE_OK))
+        return false;
+    return lept_equal_value(a.type == LEPT_RAW ? x.get_value() : a, b.type == LEPT_RAW ? y.get_value() : b, nullptr);
+}
+
+/*
+ * Pairs still to compare are kept on an explicit stack. Objects whose keys are
+ * in the same order are paired member by member; otherwise both member lists
+ * are stably sorted by key first.
+ */
+static bool lept_equal_value(const lept_value &a, const lept_value &b, LeptHashCache *cache)
+{
+    typedef std::pair<const lept_value*, const lept_value*> pair;
+    std::vector<pair> stack(1, pair(&a, &b));
+    std::vector<uint32_t> ia, ib;
+    while (!stack.empty()) {
+        const lept_value *x = stack.back().first, *y = stack.back().second;
+        stack.pop_back();
+        if (x == y)
+            continue;
+        if (x->type == LEPT_RAW || y->type == LEPT_RAW) {
+            if (!lept_equal_raw(*x, *y))
+                return false;
+            continue;
+        }
+        if (x->type != y->type)
+            return false;
+        switch (x->type) {
+            case LEPT_NUMBER:
+                if (lept_value_get_number(*x) != lept_value_get_number(*y))
+                    return false;
+                break;
+            case LEPT_STRING:
+                if (x->u.s.len != y->u.s.len || (x->u.s.len > 0 && memcmp(x->u.s.s, y->u.s.s, x->u.s.len) != 0))
+                    return false;
+                break;
+            case LEPT_ARRAY:
+            case LEPT_OBJECT: {
+                size_t size = lept_child_count(*x);
+                if (size != lept_child_count(*y))
+                    return false;
+                if (size == 0)
+                    break;
+                if (cache && cache->hash(*x) != cache->hash(*y))
+                    return false;
+                // arrays, and objects of one shape, pair up without looking at keys
+                size_t i = (x->type == LEPT_ARRAY ? size : 0);
+                if (i == 0 && lept_value_get_object_shape(*x) && lept_value_get_object_shape(*x) == lept_value_get_object_shape(*y))
+                    i = size;
+                for (; i < size && lept_key_compare(*x, i, *y, i) == 0; ++i) ;
+                if (i == size) {
+                    for (i = size; i-- > 0; )
+                        stack.push_back(pair(&lept_child(*x, i), &lept_child(*y, i)));
+                    break;
+                }
+                ia.resize(size);
+                ib.resize(size);
+                for (i = 0; i < size; ++i)
+                    ia[i] = ib[i] = (uint32_t)i;
+                std::stable_sort(ia.begin(), ia.end(), [x](uint32_t l, uint32_t r) { return lept_key_compare(*x, l, *x, r) < 0; });
+                std::stable_sort(ib.begin(), ib.end(), [y](uint32_t l, uint32_t r) { return lept_key_compare(*y, l, *y, r) < 0; });
+                for (i = 0; i < size; ++i) {
+                    if (lept_key_compare(*x, ia[i], *y, ib[i]) != 0)
+                        return false;
+                    stack.push_back(pair(lept_value_get_object_value(*x, ia[i]), lept_value_get_object_value(*y, ib[i])));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+uint64_t lept_value_hash(const lept_value &v)
+{
+    return lept_hash_value(v, nullptr);
+}
+
+bool lept_value_equal(const lept_value &a, const lept_value &b)
+{
+    return lept_equal_value(a, b, nullptr);
+}
+
+uint64_t LeptHashCache::hash(const lept_value &v)
+{
+    return lept_hash_value(v, &hashes_);
+}
+
+bool LeptHashCache::equal(const lept_value &a, const lept_value &b)
+{
+    return lept_equal_value(a, b, this);
+}
@@ -0,0 +1,41 @@
+#ifndef LEPT_HASH_H__
+#define LEPT_HASH_H__
+
+#include "leptjson.h"
+#include <unordered_map>
+
+/*
+ * Structural hashing and deep equality of value trees.
+ *
+ * Two values are equal when they have the same type and content; objects are
+ * equal when they have the same members in any order (members that share a
+ * key are matched in their relative order). Equal values always hash equal,
+ * so the hash does not depend on member order either.
+ */
+
+// fast 64-bit hash of s[0, len)
+uint64_t lept_hash_bytes(const char *s, size_t len, uint64_t seed = 0);
+
+uint64_t lept_value_hash(const lept_value &v);
+bool     lept_value_equal(const lept_value &a, const lept_value &b);
+
+/*
+ * Remembers the hash of every array and object it has hashed, keyed by node
+ * address, so comparing large and mostly identical trees stops at the first
+ * subtree whose hashes differ. The cached trees must not be changed or freed
+ * while the cache is in use; clear() it when they are.
+ */
+class LeptHashCache
+{
+  public:
+    uint64_t hash(const lept_value &v);
+    bool     equal(const lept_value &a, const lept_value &b);
+
+    void   clear()          { hashes_.clear(); }
+    size_t size() const     { return hashes_.size(); }
+
+  private:
+    std::unordered_map<const lept_value*, uint64_t> hashes_;
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "leptingest.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define LEPT_IO_URING
+#endif
+#endif
+#endif
+
+typedef std::chrono::steady_clock lept_clock;
+
+static double lept_seconds(lept_clock::time_point since)
+{
+    return std::chrono::duration<double>(lept_clock::now() - since).count();
+}
+
+// finishes a read that came back short; n is what arrived so far, or -errno
+static ssize_t lept_read_rest(int fd, char *buf, size_t len, uint64_t off, ssize_t n)
+{
+    while (n >= 0 && (size_t)n < len) {
+        ssize_t r = ::pread(fd, buf + n, len - n, (off_t)(off + n));
+        if (r == 0)
+            break;
+        if (r < 0 && errno != EINTR)
+            return -errno;
+        if (r > 0)
+            n += r;
+    }
+    return n;
+}
+
+// reads run in the background and come back in the order they were submitted
+class LeptIngest::queue
+{
+  public:
+    virtual ~queue() {}
+    virtual bool submit(int fd, char *buf, size_t len, uint64_t off) = 0;
+    // bytes read by the oldest read still outstanding, or -errno
+    virtual ssize_t wait() = 0;
+};
+
+#ifdef LEPT_IO_URING
+/*
+ * A minimal io_uring driven through the raw syscalls: one READV per block,
+ * each tagged with its slot so that completions arriving out of order are
+ * held until their turn.
+ */
+class LeptIngest::uring_queue : public LeptIngest::queue
+{
+  public:
+    // nullptr when the kernel has no io_uring or does not allow it
+    static std::unique_ptr<queue> open(unsigned entries)
+    {
+        std::unique_ptr<uring_queue> q(new uring_queue(entries));
+        if (!q->setup())
+            return nullptr;
+        return q;
+    }
+
+    ~uring_queue()
+    {
+        if (ring_ >= 0) {
+            while (head_ != tail_)
+                wait();
+            ::munmap(sqes_, sqes_len_);
+            if (cq_ptr_ != sq_ptr_)
+                ::munmap(cq_ptr_, cq_len_);
+            ::munmap(sq_ptr_, sq_len_);
+            ::close(ring_);
+        }
+    }
+
+    bool submit(int fd, char *buf, size_t len, uint64_t off)
+    {
+        assert(tail_ - head_ < slots_.size());
+        slot &s = slots_[tail_++ % slots_.size()];
+        s.iov.iov_base = buf;
+        s.iov.iov_len = len;
+        s.done = false;
+
+        unsigned tail = *sq_tail_, index = tail & *sq_mask_;
+        io_uring_sqe *sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&s.iov;
+        sqe->len = 1;
+        sqe->off = off;
+        sqe->user_data = &s - &slots_[0];
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+            if (enter(1, 0, 0) == 1)
+                return true;
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // never reached the kernel: take it back and fail it here
+                __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+                s.res = -errno;
+                s.done = true;
+                return false;
+            }
+        }
+    }
+
+    ssize_t wait()
+    {
+        assert(head_ != tail_);
+        slot &s = slots_[head_ % slots_.size()];
+        while (!s.done) {
+            unsigned head = *cq_head_;
+            if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN) {
+                    s.res = -errno; // the ring itself failed
+                    s.done = true;
+                }
+                continue;
+            }
+            const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+            slots_[cqe.user_data].res = cqe.res;
+            slots_[cqe.user_data].done = true;
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        }
+        ++head_;
+        return s.res;
+    }
+
+  private:
+    struct slot { iovec iov; ssize_t res; bool done; };
+
+    int ring_;
+    void *sq_ptr_, *cq_ptr_;
+    size_t sq_len_, cq_len_, sqes_len_;
+    unsigned *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_sqe *sqes_;
+    io_uring_cqe *cqes_;
+    std::vector<slot> slots_;
+    size_t head_, tail_;    // oldest outstanding read and the next to submit, counted from the start
+
+    explicit uring_queue(unsigned entries) : ring_(-1), slots_(entries), head_(0), tail_(0) {}
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)::syscall(__NR_io_uring_enter, ring_, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    bool setup()
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int fd = (int)::syscall(__NR_io_uring_setup, (unsigned)slots_.size(), &p);
+        if (fd < 0)
+            return false;
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_len_ = cq_len_ = (sq_len_ > cq_len_ ? sq_len_ : cq_len_);
+        sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+        sq_ptr_ = ::mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ptr_ = (p.features & IORING_FEAT_SINGLE_MMAP) ? sq_ptr_ :
+                  ::mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        void *sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) ::munmap(sqes, sqes_len_);
+            if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_len_);
+            if (sq_ptr_ != MAP_FAILED) ::munmap(sq_ptr_, sq_len_);
+            ::close(fd);
+            return false;
+        }
+        char *sq = (char*)sq_ptr_, *cq = (char*)cq_ptr_;
+        sq_tail_  = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask_  = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + p.sq_off.array);
+        cq_head_  = (unsigned*)(cq + p.cq_off.head);
+        cq_tail_  = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask_  = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_     = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        sqes_     = (io_uring_sqe*)sqes;
+        ring_ = fd;
+        return true;
+    }
+};
+#endif
+
+// the fallback: one reader thread works through the reads in order
+class LeptIngest::thread_queue : public LeptIngest::queue
+{
+  public:
+    thread_queue() : stop_(false), worker_([this] { run(); }) {}
+
+    ~thread_queue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        todo_cv_.notify_one();
+        worker_.join();
+    }
+
+    bool submit(int fd, char *buf, size_t len, uint64_t off)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            todo_.push_back(request{fd, buf, len, off});
+        }
+        todo_cv_.notify_one();
+        return true;
+    }
+
+    ssize_t wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return !done_.empty(); });
+        ssize_t n = done_.front();
+        done_.pop_front();
+        return n;
+    }
+
+  private:
+    struct request { int fd; char *buf; size_t len; uint64_t off; };
+
+    std::mutex mutex_;
+    std::condition_variable todo_cv_, done_cv_;
+    std::deque<request> todo_;
+    std::deque<ssize_t> done_;
+    bool stop_;
+    std::thread worker_;
+
+    // outstanding reads are finished before the thread stops, since their buffers are still live
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            todo_cv_.wait(lock, [this] { return stop_ || !todo_.empty(); });
+            if (todo_.empty())
+                return;
+            request r = todo_.front();
+            todo_.pop_front();
+            lock.unlock();
+            ssize_t n = lept_read_rest(r.fd, r.buf, r.len, r.off, 0);
+            lock.lock();
+            done_.push_back(n);
+            done_cv_.notify_one();
+        }
+    }
+};
+
+LeptIngest::LeptIngest(size_t block_size, unsigned depth, bool use_io_uring)
+    : block_size_(block_size > 0 ? block_size : 1), depth_(depth > 0 ? depth : 1),
+      use_io_uring_(use_io_uring), max_line_(LEPT_INGEST_MAX_LINE)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+std::unique_ptr<LeptIngest::queue> LeptIngest::open_queue()
+{
+    std::unique_ptr<queue> q;
+#ifdef LEPT_IO_URING
+    if (use_io_uring_)
+        q = uring_queue::open(depth_);
+#endif
+    stats_.io_uring = (q != nullptr);
+    if (!q)
+        q.reset(new thread_queue());
+    return q;
+}
+
+static int lept_open_regular(const char *path, off_t &size)
+{
+    struct stat st;
+    int fd = ::open(path, O_RDONLY);
+    if (fd >= 0 && (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (fd >= 0)
+        size = st.st_size;
+    return fd;
+}
+
+int LeptIngest::read_parse(const char *path, const std::function<int (const char*, size_t)> &parse)
+{
+    lept_clock::time_point start = lept_clock::now();
+    off_t size;
+    memset(&stats_, 0, sizeof(stats_));
+    int fd = lept_open_regular(path, size);
+    if (fd < 0)
+        return LEPT_PARSE_IO_ERROR;
+
+    // left uninitialized: every byte up to `end` is read over
+    std::unique_ptr<char[]> text(new char[(size_t)size + 1]);
+    size_t end = (size_t)size, blocks = (end + block_size_ - 1) / block_size_, next = 0;
+    int ret = LEPT_PARSE_OK;
+    {
+        std::unique_ptr<queue> q = open_queue();
+        auto submit = [&]() -> bool {
+            size_t off = next * block_size_;
+            return q->submit(fd, &text[off], std::min(block_size_, (size_t)size - off), off);
+        };
+        for (; next < blocks && next < depth_ && ret == LEPT_PARSE_OK; ++next)
+            if (!submit())
+                ret = LEPT_PARSE_IO_ERROR;
+        for (size_t k = 0; k < next && ret == LEPT_PARSE_OK; ++k) {
+            size_t off = k * block_size_, len = std::min(block_size_, (size_t)size - off);
+            lept_clock::time_point t = lept_clock::now();
+            ssize_t n = lept_read_rest(fd, &text[off], len, off, q->wait());
+            stats_.io_wait += lept_seconds(t);
+            if (n < 0) {
+                ret = LEPT_PARSE_IO_ERROR;
+                break;
+            }
+            stats_.bytes += n;
+            stats_.blocks++;
+            if ((size_t)n < len) {
+                // the file shrank since it was opened
+                end = off + n;
+                break;
+            }
+            if (next < blocks) {
+                if (submit())
+                    ++next;
+                else
+                    ret = LEPT_PARSE_IO_ERROR;
+            }
+        }
+        // the queue drains the reads still in flight before the text goes
+    }
+    ::close(fd);
+    if (ret == LEPT_PARSE_OK) {
+        text[end] = '\0';
+        lept_clock::time_point t = lept_clock::now();
+        ret = parse(text.get(), end);
+        stats_.parse = lept_seconds(t);
+    }
+    stats_.total = lept_seconds(start);
+    return ret;
+}
+
+int LeptIngest::read_lines(const char *path, const std::function<int (const std::string&)> &parse,
+                           const std::function<void (size_t)> &done)
+{
+    lept_clock::time_point start = lept_clock::now();
+    off_t size;
+    memset(&stats_, 0, sizeof(stats_));
+    int fd = lept_open_regular(path, size);
+    if (fd < 0)
+        return LEPT_PARSE_IO_ERROR;
+
+    std::vector<std::unique_ptr<char[]> > bufs(depth_);
+    for (auto &b : bufs)
+        b.reset(new char[block_size_]);
+    std::string carry, line;
+    int ret = LEPT_PARSE_OK;
+
+    // parses one complete line, skipping blank ones
+    auto handle = [&](const std::string &s) -> int {
+        stats_.lines++;
+        if (s.find_first_not_of(" \t\r") == std::string::npos)
+            return LEPT_PARSE_OK;
+        lept_clock::time_point t = lept_clock::now();
+        int ret = parse(s);
+        stats_.parse += lept_seconds(t);
+        if (ret == LEPT_PARSE_OK)
+            done(stats_.lines);
+        return ret;
+    };
+    // the line being put together outgrew max_line_
+    auto too_long = [&]() -> int {
+        stats_.lines++;
+        return LEPT_PARSE_VALUE_TOO_LARGE;
+    };
+
+    {
+        std::unique_ptr<queue> q = open_queue();
+        size_t blocks = ((size_t)size + block_size_ - 1) / block_size_, next = 0;
+        for (; next < blocks && next < depth_ && ret == LEPT_PARSE_OK; ++next)
+            if (!q->submit(fd, bufs[next].get(), block_size_, next * block_size_))
+                ret = LEPT_PARSE_IO_ERROR;
+        for (size_t k = 0; k < next && ret == LEPT_PARSE_OK; ++k) {
+            char *buf = bufs[k % depth_].get();
+            lept_clock::time_point t = lept_clock::now();
+            ssize_t n = lept_read_rest(fd, buf, block_size_, k * block_size_, q->wait());
+            stats_.io_wait += lept_seconds(t);
+            if (n < 0) {
+                ret = LEPT_PARSE_IO_ERROR;
+                break;
+            }
+            stats_.bytes += n;
+            stats_.blocks++;
+
+            const char *p = buf, *end = buf + n, *nl;
+            while (ret == LEPT_PARSE_OK && (nl = (const char*)memchr(p, '\n', end - p)) != nullptr) {
+                if (carry.size() + (nl - p) > max_line_) {
+                    ret = too_long();
+                    break;
+                }
+                if (carry.empty())
+                    line.assign(p, nl - p);
+                else {
+                    carry.append(p, nl - p);
+                    line.swap(carry);
+                    carry.clear();
+                }
+                ret = handle(line);
+                p = nl + 1;
+            }
+            if (ret == LEPT_PARSE_OK) {
+                if (carry.size() + (end - p) > max_line_)
+                    ret = too_long();
+                else
+                    carry.append(p, end - p);
+            }
+
+            if ((size_t)n < block_size_)
+                blocks = next;  // the end of the file
+            if (next < blocks) {
+                if (q->submit(fd, buf, block_size_, next * block_size_))
+                    ++next;
+                else
+                    ret = LEPT_PARSE_IO_ERROR;
+            }
+        }
+        // the queue drains the reads still in flight before the buffers go
+    }
+    ::close(fd);
+    if (ret == LEPT_PARSE_OK && !carry.empty())
+        ret = handle(carry);
+    stats_.total = lept_seconds(start);
+    return ret;
+}
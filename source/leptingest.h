@@ -0,0 +1,92 @@
+#ifndef LEPT_INGEST_H__
+#define LEPT_INGEST_H__
+
+#include "leptjson.h"
+#include <functional>
+
+#ifndef LEPT_INGEST_BLOCK_SIZE
+#define LEPT_INGEST_BLOCK_SIZE (1 << 20)
+#endif
+
+#ifndef LEPT_INGEST_DEPTH
+#define LEPT_INGEST_DEPTH 3
+#endif
+
+#ifndef LEPT_INGEST_MAX_LINE
+#define LEPT_INGEST_MAX_LINE (64 << 20)
+#endif
+
+// where the time of the last LeptIngest call went, in seconds
+struct lept_ingest_stats
+{
+    size_t bytes, blocks;
+    size_t lines;       // NDJSON lines read; after an error, the failing line
+    double io_wait;     // waiting for a block that had not arrived yet
+    double parse;       // parsing, callbacks excluded
+    double total;
+    bool   io_uring;    // false when the reads went through the thread fallback
+};
+
+/*
+ * Reads a regular file with `depth` block reads in flight.
+ *
+ *     LeptIngest in;
+ *     LeptJson doc;
+ *     int ret = in.parse("big.json", doc);
+ *     ret = in.parse_ndjson("log.ndjson", [](size_t line, const LeptJson &doc) { ... });
+ *
+ * Reads are queued on an io_uring when the kernel offers one (set up with raw
+ * syscalls, no liburing); otherwise a reader thread issues them with pread().
+ *
+ * parse() reads the blocks straight into the document text and parses it
+ * once the last block is in: the reads overlap one another, not the parse.
+ * parse_ndjson() parses each line as soon as its block arrives and hands the
+ * document to the callback, while the next blocks load. Only `depth` blocks
+ * and the line that straddles two of them are kept; io_wait against total in
+ * stats() shows how much of the I/O the parsing hid.
+ */
+class LeptIngest
+{
+  public:
+    typedef std::function<void (size_t line, const LeptJson &doc)> callback;
+
+    explicit LeptIngest(size_t block_size = LEPT_INGEST_BLOCK_SIZE, unsigned depth = LEPT_INGEST_DEPTH,
+                        bool use_io_uring = true);
+
+    template <unsigned parseFlags = LEPT_PARSE_FLAG_DEFAULT>
+    int parse(const char *path, LeptJson &doc)
+    {
+        return read_parse(path, [&doc](const char *json, size_t len) { return doc.parse<parseFlags>(json, len); });
+    }
+    // blank lines are skipped; stops at the first line that fails to parse, or that
+    // is longer than set_max_line() allows (LEPT_PARSE_VALUE_TOO_LARGE)
+    template <unsigned parseFlags = LEPT_PARSE_FLAG_DEFAULT>
+    int parse_ndjson(const char *path, const callback &cb)
+    {
+        LeptJson doc;
+        return read_lines(path, [&doc](const std::string &json) { return doc.parse<parseFlags>(json); },
+                          [&doc, &cb](size_t line) { cb(line, doc); });
+    }
+
+    // parse_ndjson() holds at most `size` bytes of one line in memory
+    void set_max_line(size_t size)          { max_line_ = size; }
+    const lept_ingest_stats& stats() const  { return stats_; }
+
+  private:
+    class queue;
+    class uring_queue;
+    class thread_queue;
+
+    size_t block_size_;
+    unsigned depth_;
+    bool use_io_uring_;
+    size_t max_line_;
+    lept_ingest_stats stats_;
+
+    std::unique_ptr<queue> open_queue();
+    int read_parse(const char *path, const std::function<int (const char*, size_t)> &parse);
+    int read_lines(const char *path, const std::function<int (const std::string&)> &parse,
+                   const std::function<void (size_t)> &done);
+};
+
+#endif
@@ -1,8 +1,19 @@
 #include "leptjson.h"
+#include "leptreclaimer.h"
+#include "leptprojection.h"
+#include "lepthash.h"
+#include <algorithm>
 #include <cmath>  // HUGE_VAL 
 #include <cerrno> // errno
 #include <cstdlib> // strtod
 #include <cstring>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define LEPT_SSE2
+#endif
+
+// returned by lept_parse_key when the rest of an object is skipped by a projection
+#define LEPT_PARSE_OBJECT_END (-1)
 
 #define EXPECT(c, ch) do { assert(*c.json == (ch)); c.json++; } while(0)
 #define ISDIGITS(ch)    ((ch) >= '0' && (ch) <= '9')
@@ -16,8 +27,125 @@
 #define LEPT_STRINGIFY_STACK_INIT_SIZE 256
 #endif
 
+#if defined(__GNUC__)
+#define LEPT_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address, no_sanitize_thread))
+#else
+#define LEPT_NO_SANITIZE_ADDRESS
+#endif
+
 using std::shared_ptr;
 
+/*
+ * Length of the well-formed UTF-8 sequence at s (at most avail bytes), or 0
+ * for an invalid one: overlong forms, surrogates and code points above
+ * U+10FFFF are rejected as in table 3-7 of the Unicode standard.
+ */
+static inline size_t lept_utf8_length(const unsigned char *s, size_t avail)
+{
+    unsigned char lo = 0x80, hi = 0xBF;
+    size_t n;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) n = 2;
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        n = 3;
+        if (s[0] == 0xE0) lo = 0xA0;
+        else if (s[0] == 0xED) hi = 0x9F;
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        n = 4;
+        if (s[0] == 0xF0) lo = 0x90;
+        else if (s[0] == 0xF4) hi = 0x8F;
+    }
+    else return 0;
+    if (avail < n || s[1] < lo || s[1] > hi)
+        return 0;
+    for (size_t i = 2; i < n; ++i)
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+    return n;
+}
+
+template <bool checkUtf8>
+static inline bool lept_string_special(unsigned char ch)
+{
+    return ch == '\"' || ch == '\\' || ch < 0x20 || (checkUtf8 && ch >= 0x80);
+}
+
+/*
+ * Returns the first char at or after p that the string parser has to look at:
+ * a quote, a backslash, a control char (the terminating NUL included) or, with
+ * checkUtf8, any non-ASCII byte. SSE2 tests 16 bytes at a time; the loads are
+ * aligned, so they never reach into a page beyond the one holding the NUL.
+ */
+template <bool checkUtf8>
+LEPT_NO_SANITIZE_ADDRESS
+static inline const char* lept_scan_string(const char *p)
+{
+#ifdef LEPT_SSE2
+    for (; ((uintptr_t)p & 15) != 0; ++p)
+        if (lept_string_special<checkUtf8>(*p))
+            return p;
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (;; p += 16) {
+        __m128i x = _mm_load_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+        int mask = _mm_movemask_epi8(m) | (checkUtf8 ? _mm_movemask_epi8(x) : 0);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#else
+    while (!lept_string_special<checkUtf8>(*p))
+        ++p;
+    return p;
+#endif
+}
+
+// first char in [p, end) that must be escaped when written out, or end
+static inline const char* lept_scan_escape(const char *p, const char *end)
+{
+#ifdef LEPT_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p != end; ++p)
+        if (lept_string_special<false>(*p))
+            return p;
+    return end;
+}
+
+bool lept_validate_utf8(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char*)s, *end = p + len;
+    while (p < end) {
+#ifdef LEPT_SSE2
+        while (end - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)))
+            p += 16;
+        if (p == end)
+            break;
+#endif
+        if (*p < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t n = lept_utf8_length(p, end - p);
+        if (n == 0)
+            return false;
+        p += n;
+    }
+    return true;
+}
+
 void LeptJson::lept_parse_whitespace(lept_context &ctx)
 {
     const char *p = ctx.json;
@@ -26,10 +154,11 @@ void LeptJson::lept_parse_whitespace(lept_context &ctx)
     ctx.json = p;
 }
 
-int LeptJson::lept_parse_literal(lept_context &ctx, lept_value &v, const std::string &literal, lept_type type)
+template <unsigned parseFlags>
+int LeptJson::lept_parse_literal(lept_context &ctx, lept_value &v, const char *literal, lept_type type)
 {
-    for(size_t i = 0; i < literal.size(); ++i) {
-        if(*ctx.json != literal[i])
+    for(; *literal; ++literal) {
+        if(!(parseFlags & LEPT_PARSE_FLAG_TRUSTED) && *ctx.json != *literal)
             return LEPT_PARSE_INVALID_VALUE;
         ctx.json++;
     }
@@ -37,8 +166,51 @@ int LeptJson::lept_parse_literal(lept_context &ctx, lept_value &v, const std::st
     return LEPT_PARSE_OK;
 }
 
+static inline bool lept_number_char(char ch)
+{
+    return ISDIGITS(ch) || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E';
+}
+
+/*
+ * A lazy number keeps the address of its text split over the spare bytes of
+ * the value; addresses above 48 bits (never seen in user space today) are
+ * converted right away instead.
+ */
+static inline bool lept_set_lazy_number(lept_value &v, const char *p)
+{
+    uint64_t addr = (uint64_t)(uintptr_t)p;
+    if (sizeof(void*) > 8 || (addr >> 48) != 0)
+        return false;
+    v.type = LEPT_NUMBER;
+    v.flags = LEPT_VALUE_FLAG_LAZY_NUMBER;
+    v.u.lazy.lo = (uint32_t)addr;
+    v.ext = (uint16_t)(addr >> 32);
+    return true;
+}
+
+static inline const char* lept_lazy_number_text(const lept_value &v)
+{
+    return (const char*)(uintptr_t)(((uint64_t)v.ext << 32) | v.u.lazy.lo);
+}
+
+template <unsigned parseFlags>
 int LeptJson::lept_parse_number(lept_context &ctx, lept_value &v)
 {
+    if ((parseFlags & LEPT_PARSE_FLAG_TRUSTED) && (parseFlags & LEPT_PARSE_FLAG_LAZY_NUMBERS)) {
+        const char *p = ctx.json;
+        for (; lept_number_char(*p); ++p) ;
+        if (lept_set_lazy_number(v, ctx.json)) {
+            ctx.json = p;
+            return LEPT_PARSE_OK;
+        }
+    }
+    if (parseFlags & LEPT_PARSE_FLAG_TRUSTED) {
+        char *end;
+        v.u.num = strtod(ctx.json, &end);
+        v.type = LEPT_NUMBER;
+        ctx.json = end;
+        return LEPT_PARSE_OK;
+    }
     const char *p = ctx.json;
     if (*p == '-') p++; // minus
     if (*p == '0') p++; // integrate part
@@ -57,6 +229,10 @@ int LeptJson::lept_parse_number(lept_context &ctx, lept_value &v)
         if(!ISDIGITS(*p)) return LEPT_PARSE_INVALID_VALUE;
         for (++p ; ISDIGITS(*p); ++p) ;
     }
+    if ((parseFlags & LEPT_PARSE_FLAG_LAZY_NUMBERS) && lept_set_lazy_number(v, ctx.json)) {
+        ctx.json = p;
+        return LEPT_PARSE_OK;
+    }
     errno = 0;
     // try {
     //     v.u.num = std::stod(ctx.json, nullptr);
@@ -74,13 +250,107 @@ int LeptJson::lept_parse_number(lept_context &ctx, lept_value &v)
     return LEPT_PARSE_OK;
 }
 
+double lept_value_convert_number(const lept_value &v)
+{
+    assert(v.type == LEPT_NUMBER);
+    if ((v.flags & (LEPT_VALUE_FLAG_LAZY_NUMBER | LEPT_VALUE_FLAG_NUMBER_CACHED)) != LEPT_VALUE_FLAG_LAZY_NUMBER)
+        return v.u.num;
+    return strtod(lept_lazy_number_text(v), nullptr); // nothing is written: v may be read by other threads
+}
+
+void LeptJson::materialize_numbers()
+{
+    std::vector<lept_value*> pending{&parsed_v_};
+    while (!pending.empty()) {
+        lept_value *cur = pending.back();
+        pending.pop_back();
+        size_t size = 0;
+        lept_value *e = nullptr;
+        switch (cur->type) {
+            case LEPT_NUMBER:
+                if ((cur->flags & (LEPT_VALUE_FLAG_LAZY_NUMBER | LEPT_VALUE_FLAG_NUMBER_CACHED)) == LEPT_VALUE_FLAG_LAZY_NUMBER) {
+                    cur->u.lazy.num = strtod(lept_lazy_number_text(*cur), nullptr);
+                    cur->flags |= LEPT_VALUE_FLAG_NUMBER_CACHED;
+                }
+                continue;
+            case LEPT_ARRAY:
+                size = cur->u.a.size;
+                e = cur->u.a.e;
+                break;
+            case LEPT_OBJECT:
+                if (cur->flags & LEPT_VALUE_FLAG_SHAPED) {
+                    size = cur->u.shaped.size;
+                    e = (lept_value*)(cur->u.shaped.p + 1);
+                    break;
+                }
+                for (size_t i = 0; i < cur->u.obj.size; ++i)
+                    pending.push_back(&cur->u.obj.m[i].v);
+                continue;
+            default:
+                continue;
+        }
+        for (size_t i = 0; i < size; ++i)
+            pending.push_back(&e[i]);
+    }
+}
+
+const char* lept_value_get_number_lexeme(const lept_value &v, size_t &len)
+{
+    if (v.type != LEPT_NUMBER || !(v.flags & LEPT_VALUE_FLAG_LAZY_NUMBER))
+        return nullptr;
+    const char *s = lept_lazy_number_text(v), *p = s;
+    for (; lept_number_char(*p); ++p) ;
+    len = p - s;
+    return s;
+}
+
+size_t lept_value_find_object_index(const lept_value &v, const char *key, size_t klen, lept_key_cache *cache)
+{
+    const lept_shape *shape = lept_value_get_object_shape(v);
+    if (cache && shape && cache->shape == shape)
+        return cache->index;
+    size_t i = 0, size = v.u.obj.size;
+    for (; i < size; ++i)
+        if (lept_value_get_object_key_length(v, i) == klen && memcmp(lept_value_get_object_key(v, i), key, klen) == 0)
+            break;
+    if (cache && shape) {
+        cache->shape = shape;
+        cache->index = i;
+    }
+    return i;
+}
+
+bool lept_value_get_int64(const lept_value &v, int64_t &i)
+{
+    size_t len;
+    const char *s = lept_value_get_number_lexeme(v, len);
+    if (s && !memchr(s, '.', len) && !memchr(s, 'e', len) && !memchr(s, 'E', len)) {
+        // plain integer text: read it exactly instead of through a double
+        char *end;
+        errno = 0;
+        long long ll = strtoll(s, &end, 10);
+        if (errno == ERANGE)
+            return false;
+        i = ll;
+        return true;
+    }
+    double d = lept_value_get_number(v);
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0) || d != (double)(int64_t)d)
+        return false;
+    i = (int64_t)d;
+    return true;
+}
+
 #define PUTC(ctx, ch) do { *(char*)ctx.push(sizeof(char)) = (ch); } while (0)
+#define PUTS(ctx, s, len) memcpy((char*)ctx.push(len), s, len)
+template <unsigned parseFlags>
 const char* LeptJson::lept_parse_hex4(const char *json, unsigned &u)
 {
     u = 0;
     for (unsigned i = 0; i < 4; ++i) {
         auto ch = json[i];
-        if (ISDIGITS(ch))                   u = (u << 4) + (ch - '0');
+        if (parseFlags & LEPT_PARSE_FLAG_TRUSTED) u = (u << 4) + (ch & 0x0F) + (ch >> 6) * 9;
+        else if (ISDIGITS(ch))                   u = (u << 4) + (ch - '0');
         else if ((ch) >='A' && (ch) <= 'F') u = (u << 4) + (ch - 'A') + 10;
         else if ((ch) >='a' && (ch) <= 'f') u = (u << 4) + (ch - 'a') + 10;
         else return nullptr;
@@ -111,25 +381,42 @@ void LeptJson::lept_encode_utf8(lept_context &ctx, unsigned u)
     }
 }
 
+template <unsigned parseFlags>
 int LeptJson::lept_parse_string(lept_context &ctx, lept_value &v)
 {
     char *str;
     size_t len;
-    int ret = lept_parse_string_raw(ctx, &str, len);
+    const char *begin = ctx.json;
+    int ret = lept_parse_string_raw<parseFlags>(ctx, &str, len);
     if (ret != LEPT_PARSE_OK) 
         return ret;
+    if (len > LEPT_SIZE_MAX)
+        return LEPT_PARSE_VALUE_TOO_LARGE;  // would not fit u.s.len
     lept_set_string(v, str, len);
+    /*
+     * every escape decodes to fewer bytes than its source, so a string as long as
+     * its source text had none, and holds nothing that has to be escaped again
+     */
+    if (!(parseFlags & (LEPT_PARSE_FLAG_TRUSTED | LEPT_PARSE_FLAG_NO_ESCAPES)) && len == (size_t)(ctx.json - begin - 2))
+        v.flags = LEPT_VALUE_FLAG_NO_ESCAPE;
     return ret;
 }
 
 
 #define STRING_ERROR(ret) do { ctx.top = head; return ret; } while (0)
+template <unsigned parseFlags>
 int LeptJson::lept_parse_string_raw(lept_context &ctx, char **str, size_t &len)
 {
     EXPECT(ctx, '\"');
     const auto *p = ctx.json;
     size_t head = ctx.top;
     for (;;) {
+        // runs of plain chars are copied in one go
+        const char *q = lept_scan_string<(parseFlags & LEPT_PARSE_FLAG_VALIDATE_UTF8) != 0>(p);
+        if (q != p) {
+            PUTS(ctx, p, q - p);
+            p = q;
+        }
         auto ch = *p++;
         switch (ch) {
             case '\"':
@@ -140,6 +427,10 @@ int LeptJson::lept_parse_string_raw(lept_context &ctx, char **str, size_t &len)
             case '\0':
                 STRING_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK);
             case '\\':
+                if (parseFlags & LEPT_PARSE_FLAG_NO_ESCAPES) {
+                    PUTC(ctx, ch);
+                    break;
+                }
                 switch (*p++) {
                     case '\"': PUTC(ctx, '\"'); break;
                     case '\\': PUTC(ctx, '\\'); break;
@@ -151,19 +442,21 @@ int LeptJson::lept_parse_string_raw(lept_context &ctx, char **str, size_t &len)
                     case 't': PUTC(ctx, '\t'); break; 
                     case 'u':
                         unsigned u; // codepoint
-                        if (!(p = lept_parse_hex4(p, u))) 
+                        if (!(p = lept_parse_hex4<parseFlags>(p, u))) 
                             STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
                         if (u >= 0xD800 && u <= 0xDBFF) { //surrogate pair
                             unsigned ls;
-                            if (*p != '\\' || *(p + 1) != 'u')
+                            if (!(parseFlags & LEPT_PARSE_FLAG_TRUSTED) && (*p != '\\' || *(p + 1) != 'u'))
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
                             p += 2;
-                            if (!(p = lept_parse_hex4(p, ls))) 
+                            if (!(p = lept_parse_hex4<parseFlags>(p, ls))) 
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
-                            if (ls < 0xDC00 || ls > 0xDFFF)
+                            if (!(parseFlags & LEPT_PARSE_FLAG_TRUSTED) && (ls < 0xDC00 || ls > 0xDFFF))
                                 STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
                             u = 0x10000 + ((u - 0xD800) << 10) + (ls - 0xDC00);
                         }
+                        else if ((parseFlags & LEPT_PARSE_FLAG_VALIDATE_UTF8) && u >= 0xDC00 && u <= 0xDFFF)
+                            STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE); // would encode to invalid UTF-8
                         lept_encode_utf8(ctx, u);
                         break;
                     default: 
@@ -171,7 +464,15 @@ int LeptJson::lept_parse_string_raw(lept_context &ctx, char **str, size_t &len)
                 }
                 break;
             default: 
-                if ((unsigned char)ch < 0x20) {
+                if ((parseFlags & LEPT_PARSE_FLAG_VALIDATE_UTF8) && (unsigned char)ch >= 0x80) {
+                    size_t n = lept_utf8_length((const unsigned char*)p - 1, (size_t)-1);
+                    if (n == 0)
+                        STRING_ERROR(LEPT_PARSE_INVALID_UTF8);
+                    PUTS(ctx, p - 1, n);
+                    p += n - 1;
+                    break;
+                }
+                if (!(parseFlags & LEPT_PARSE_FLAG_TRUSTED) && (unsigned char)ch < 0x20) {
                    STRING_ERROR(LEPT_PARSE_INVALID_STRING_CHAR);
                 }
                 PUTC(ctx, ch);
@@ -180,151 +481,433 @@ int LeptJson::lept_parse_string_raw(lept_context &ctx, char **str, size_t &len)
 
 }
 
-int LeptJson::lept_parse_array(lept_context &ctx, lept_value &v)
+/*
+ * Skips one value without building it. Strings are scanned up to their closing
+ * quote and every closing bracket must match the kind of the one it closes, so
+ * the skipped text is checked for structure but not validated; nothing is
+ * allocated. Brackets nested deeper than max_depth, which is capped at
+ * LEPT_PARSE_MAX_DEPTH, fail with LEPT_PARSE_DEPTH_EXCEEDED.
+ */
+int LeptJson::lept_skip_value(lept_context &ctx, size_t max_depth)
 {
-    EXPECT(ctx, '[');
-    int ret, size = 0;
-    lept_parse_whitespace(ctx);
-    if (*ctx.json == ']') {
-        ctx.json++ ;
-        v.type = LEPT_ARRAY;
-        v.u.a.size = 0;
-        v.u.a.e = nullptr;
-        return LEPT_PARSE_OK;
-    }
+    const char *p = ctx.json;
+    size_t depth = 0;
+    unsigned long long objects[LEPT_PARSE_MAX_DEPTH / 64 + 1]; // bit per open bracket: set for '{'
+    max_depth = std::min<size_t>(max_depth, LEPT_PARSE_MAX_DEPTH);
+    if (*p == '\0')
+        return LEPT_PARSE_EXPECT_VALUE;
+    do {
+        switch (*p) {
+            case '\0':
+                return LEPT_PARSE_INVALID_VALUE; // unbalanced container
+            case '\"':
+                for (++p; *p != '\"'; ++p) {
+                    if (*p == '\0')
+                        return LEPT_PARSE_MISS_QUOTATION_MARK;
+                    if (*p == '\\' && p[1] != '\0')
+                        ++p;
+                }
+                ++p;
+                break;
+            case '[': case '{':
+                if (depth == max_depth)
+                    return LEPT_PARSE_DEPTH_EXCEEDED;
+                if (*p == '{')
+                    objects[depth / 64] |= 1ULL << (depth % 64);
+                else
+                    objects[depth / 64] &= ~(1ULL << (depth % 64));
+                ++depth; ++p;
+                break;
+            case ']': case '}':
+                if (depth == 0)
+                    return LEPT_PARSE_INVALID_VALUE;
+                --depth;
+                if (((objects[depth / 64] >> (depth % 64)) & 1) != (*p == '}'))
+                    return *p == '}' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                ++p;
+                break;
+            default:
+                if (depth > 0) {
+                    ++p;
+                    break;
+                }
+                // a literal or a number at the top: runs until the next delimiter
+                for (; *p && *p != ',' && *p != ']' && *p != '}' && *p != ':' && 
+                       *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'; ++p) ;
+                if (p == ctx.json)
+                    return LEPT_PARSE_INVALID_VALUE;
+        }
+    } while (depth > 0);
+    ctx.json = p;
+    return LEPT_PARSE_OK;
+}
+
+/*
+ * Under LEPT_PARSE_FLAG_SHAPES an object's members wait on the stack as its
+ * key length, its key padded to 8 bytes, and its value, so that no key is
+ * copied to the heap unless it starts a new shape.
+ */
+static inline size_t lept_stacked_key_size(size_t klen)
+{
+    return sizeof(size_t) + ((klen + 7) & ~(size_t)7);
+}
+
+static inline const char* lept_stacked_key(const char *m, size_t &klen)
+{
+    memcpy(&klen, m, sizeof(size_t));
+    return m + sizeof(size_t);
+}
+
+static inline lept_value* lept_stacked_value(const char *m)
+{
+    size_t klen;
+    lept_stacked_key(m, klen);
+    return (lept_value*)(m + lept_stacked_key_size(klen));
+}
+
+static inline const char* lept_stacked_next(const char *m)
+{
+    return (const char*)(lept_stacked_value(m) + 1);
+}
+
+/*
+ * Parses the key and the colon of the next object member; the key is owned by
+ * the frame until the member's value is complete. Under a projection, members
+ * that are not selected are skipped here, and LEPT_PARSE_OBJECT_END is
+ * returned (with the '}' consumed) when no selected member is left.
+ */
+template <unsigned parseFlags>
+int LeptJson::lept_parse_key(lept_context &ctx, lept_frame &f, const LeptProjection *proj, size_t skip_depth)
+{
+    char *key;
+    size_t klen;
+    int ret;
     for (;;) {
-        lept_value element;   
-        element.type = LEPT_NULL;
-        if ((ret = lept_parse_value(ctx, element)) != LEPT_PARSE_OK)
+        if (*ctx.json != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = lept_parse_string_raw<parseFlags>(ctx, &key, klen)) != LEPT_PARSE_OK)
+            return ret;
+        lept_parse_whitespace(ctx);
+        if (*ctx.json != ':')
+            return LEPT_PARSE_MISS_COLON;
+        ctx.json++;
+        lept_parse_whitespace(ctx);
+        f.vproj = (f.proj == LEPT_PROJECTION_ALL ? LEPT_PROJECTION_ALL : proj->find(f.proj, key, klen));
+        if (f.vproj != LEPT_PROJECTION_NONE)
             break;
-        memcpy((lept_value*)ctx.push(sizeof(lept_value)), &element, sizeof(element)); // push one element to stack
-        size++;
+        if ((ret = lept_skip_value(ctx, skip_depth)) != LEPT_PARSE_OK)
+            return ret;
         lept_parse_whitespace(ctx);
-        if (*ctx.json == ',') { 
+        if (*ctx.json == '}') {
             ctx.json++;
-            lept_parse_whitespace(ctx);
+            return LEPT_PARSE_OBJECT_END;
         }
-        else if (*ctx.json == ']') {
-            ctx.json++;
-            v.type = LEPT_ARRAY;
-            v.u.a.size = size;
-            auto copysize = size * sizeof(lept_value);
-            memcpy(v.u.a.e = new lept_value[size], (lept_value*)ctx.pop(copysize), copysize);
-            return LEPT_PARSE_OK; 
+        if (*ctx.json != ',')
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        ctx.json++;
+        lept_parse_whitespace(ctx);
+    }
+    if (parseFlags & LEPT_PARSE_FLAG_SHAPES) {
+        // the key stays on the stack, where it was just decoded, until the object is closed
+        size_t at = ctx.top;
+        ctx.top += klen;
+        ctx.push(lept_stacked_key_size(klen) - klen);
+        char *p = ctx.stack.get() + at;
+        memmove(p + sizeof(size_t), p, klen);
+        memcpy(p, &klen, sizeof(size_t));
+        return LEPT_PARSE_OK;
+    }
+    /*
+    `key` point to a tempaorary stack space, so the data which `key` point to should be 
+    copy to a new space for lept_member mem to store;
+    */
+    f.k = new char[klen+1];
+    if (klen > 0) // an empty key may come before anything was pushed, with no stack to point into
+        memcpy(f.k, key, klen);
+    f.klen = klen;
+    f.k[klen] = '\0';
+    return LEPT_PARSE_OK;
+}
+
+static void lept_release_shape(lept_shape *shape)
+{
+    if (--shape->refs > 0)
+        return;
+    for (size_t i = 0; i < shape->size; ++i)
+        delete []shape->keys[i].k;
+    delete []shape->keys;
+    delete shape;
+}
+
+/*
+ * The table holds a reference to each shape, so a shape freed with a partial
+ * tree on an error cannot be found again.
+ */
+LeptJson::lept_shapes::~lept_shapes()
+{
+    for (auto &bucket : table)
+        for (lept_shape *shape : bucket.second)
+            lept_release_shape(shape);
+}
+
+// the shape with the keys of the n stacked members, referenced once more; keys are copied only for a new shape
+lept_shape* LeptJson::lept_shapes::intern(const char *members, size_t n)
+{
+    const char *m, *k;
+    size_t klen, i;
+    uint64_t h = n;
+    for (m = members, i = 0; i < n; m = lept_stacked_next(m), ++i) {
+        k = lept_stacked_key(m, klen);
+        h = lept_hash_bytes(k, klen, h);
+    }
+    std::vector<lept_shape*> &bucket = table[h];
+    for (lept_shape *shape : bucket) {
+        if (shape->size != n)
+            continue;
+        for (m = members, i = 0; i < n; m = lept_stacked_next(m), ++i) {
+            k = lept_stacked_key(m, klen);
+            if (shape->keys[i].klen != klen || memcmp(shape->keys[i].k, k, klen) != 0)
+                break;
         }
-        else { 
-            ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-            break;
+        if (i == n) {
+            shape->refs++;
+            return shape;
         }
     }
-    // pop and free stack when parse array error;
-    for (int i =0; i < size; ++i) {
-        lept_free(*(lept_value *)ctx.pop(sizeof(lept_value)));
+    lept_shape *shape = new lept_shape;
+    shape->size = n;
+    shape->refs = 2; // the table and the object
+    shape->keys = new lept_key[n];
+    for (m = members, i = 0; i < n; m = lept_stacked_next(m), ++i) {
+        k = lept_stacked_key(m, klen);
+        memcpy(shape->keys[i].k = new char[klen + 1], k, klen);
+        shape->keys[i].k[klen] = '\0';
+        shape->keys[i].klen = klen;
     }
-    return ret;
+    bucket.push_back(shape);
+    return shape;
 }
 
-int LeptJson::lept_parse_object(lept_context &ctx, lept_value &v)
+/*
+ * pop the f.size elements (or members) of a closed container off the stack into v;
+ * with `shapes`, an object is stored as its shape and its values
+ */
+void LeptJson::lept_parse_end(lept_context &ctx, lept_value &v, const lept_frame &f, lept_shapes *shapes)
 {
-    EXPECT(ctx, '{');
-    int ret;
-    lept_member mem;
-    char *key = nullptr;
-    size_t klen, size = 0;
-
-    lept_parse_whitespace(ctx);
-    if (*ctx.json == '}') {
-        ctx.json++;
+    v.flags = 0;
+    if (f.type == LEPT_ARRAY) {
+        v.type = LEPT_ARRAY;
+        v.u.a.size = f.size;
+        v.u.a.e = nullptr;
+        if (f.size > 0) {
+            auto copysize = f.size * sizeof(lept_value);
+            memcpy(v.u.a.e = new lept_value[f.size], (lept_value*)ctx.pop(copysize), copysize);
+        }
+    }
+    else if (shapes && f.size > 0) {
+        const char *members = ctx.stack.get() + f.base, *m = members;
         v.type = LEPT_OBJECT;
-        v.u.obj.size = 0;
+        if (f.size <= LEPT_PARSE_SHAPE_MAX_SIZE) {
+            lept_shape **p = (lept_shape**)new char[sizeof(lept_shape*) + f.size * sizeof(lept_value)];
+            lept_value *e = (lept_value*)(p + 1);
+            for (size_t i = 0; i < f.size; m = lept_stacked_next(m), ++i)
+                memcpy(&e[i], lept_stacked_value(m), sizeof(lept_value));
+            *p = shapes->intern(members, f.size);
+            v.flags = LEPT_VALUE_FLAG_SHAPED;
+            v.u.shaped.p = p;
+            v.u.shaped.size = f.size;
+        }
+        else { // too many keys to be worth a shape: a plain object after all
+            v.u.obj.size = f.size;
+            v.u.obj.m = new lept_member[f.size];
+            for (size_t i = 0; i < f.size; m = lept_stacked_next(m), ++i) {
+                size_t klen;
+                const char *k = lept_stacked_key(m, klen);
+                lept_member &mem = v.u.obj.m[i];
+                memcpy(mem.k = new char[klen + 1], k, klen);
+                mem.k[klen] = '\0';
+                mem.klen = klen;
+                memcpy(&mem.v, lept_stacked_value(m), sizeof(lept_value));
+            }
+        }
+        ctx.top = f.base;
+    }
+    else {
+        v.type = LEPT_OBJECT;
+        v.u.obj.size = f.size;
         v.u.obj.m = nullptr;
-        return LEPT_PARSE_OK;
+        if (f.size > 0) {
+            auto copysize = f.size * sizeof(lept_member);
+            memcpy(v.u.obj.m = new lept_member[f.size], (lept_member*)ctx.pop(copysize), copysize);
+        }
     }
+}
+
+/*
+ * Arrays and objects are parsed with an explicit stack of frames instead of
+ * recursion, so the native stack use does not depend on the nesting depth.
+ * Finished elements and members are pushed on ctx's stack as before and moved
+ * into their container when its closing bracket is seen. `depth` is the number
+ * of containers already open around v; `proj`, when given, selects the object
+ * members that are built.
+ */
+template <unsigned parseFlags>
+int LeptJson::lept_parse_value(lept_context &ctx, lept_value &v, size_t depth, const LeptProjection *proj)
+{
+    std::vector<lept_frame> stack;
+    lept_shapes *shapes = (parseFlags & LEPT_PARSE_FLAG_SHAPES) ? ctx.shapes : nullptr;
+    lept_value e;
+    int ret;
+    // the containers a member skipped by the projection may open, as many as parsing it would allow
+    auto skip_depth = [&]() -> size_t {
+        size_t open = depth + stack.size();
+        return open < max_depth_ ? max_depth_ - open : 0;
+    };
     for (;;) {
-        if (*ctx.json != '\"') {
-            ret = LEPT_PARSE_MISS_KEY;
-            break;
+        e.type = LEPT_NULL;
+        e.flags = 0;
+        switch (*ctx.json) {
+            case 'n': ret = lept_parse_literal<parseFlags>(ctx, e, "null", LEPT_NULL); break;
+            case 't': ret = lept_parse_literal<parseFlags>(ctx, e, "true", LEPT_TRUE); break;
+            case 'f': ret = lept_parse_literal<parseFlags>(ctx, e, "false", LEPT_FALSE); break;
+            case '"': ret = lept_parse_string<parseFlags>(ctx, e); break;
+            case '\0': ret = LEPT_PARSE_EXPECT_VALUE; break;
+            case '[':
+            case '{': {
+                if (depth + stack.size() >= max_depth_) {
+                    ret = LEPT_PARSE_DEPTH_EXCEEDED;
+                    break;
+                }
+                lept_frame f = { *ctx.json == '[' ? LEPT_ARRAY : LEPT_OBJECT, 0, nullptr, 0,
+                                 LEPT_PROJECTION_ALL, LEPT_PROJECTION_ALL, ctx.top };
+                char close = (f.type == LEPT_ARRAY ? ']' : '}');
+                if (proj) // the projection of this container: arrays hand theirs down to the elements
+                    f.proj = f.vproj = (stack.empty() ? proj->root() : stack.back().vproj);
+                ctx.json++;
+                lept_parse_whitespace(ctx);
+                if (*ctx.json == close) {
+                    ctx.json++;
+                    lept_parse_end(ctx, e, f, shapes);
+                    ret = LEPT_PARSE_OK;
+                    break;
+                }
+                stack.push_back(f);
+                if (f.type == LEPT_OBJECT &&
+                    (ret = lept_parse_key<parseFlags>(ctx, stack.back(), proj, skip_depth())) != LEPT_PARSE_OK) {
+                    if (ret == LEPT_PARSE_OBJECT_END) { // no member selected
+                        stack.pop_back();
+                        lept_parse_end(ctx, e, f, shapes);
+                        ret = LEPT_PARSE_OK;
+                    }
+                    break;
+                }
+                continue; // go on with the first element
+            }
+            default: ret = lept_parse_number<parseFlags>(ctx, e); break;
         }
-        if ((ret = lept_parse_string_raw(ctx, &key, klen)) != LEPT_PARSE_OK)
-            break;
-        /*
-        `key` point to a tempaorary stack space, so the data which `key` point to should be 
-        copy to a new space for lept_member mem to store;
-        */
-        memcpy(mem.k = new char[klen+1], key, klen);
-        mem.klen = klen;
-        mem.k[klen] = '\0';
-        key = nullptr;
-        lept_parse_whitespace(ctx);
-        
-        if (*ctx.json != ':') {
-            ret = LEPT_PARSE_MISS_COLON;
-            break;
+        if (ret == LEPT_PARSE_OK && e.type == LEPT_STRING && e.u.s.len > max_size_) {
+            lept_free(e);
+            ret = LEPT_PARSE_VALUE_TOO_LARGE;
         }
-        ctx.json++;
-        lept_parse_whitespace(ctx);
-
-        if ((ret = lept_parse_value(ctx, mem.v)) != LEPT_PARSE_OK) 
+        if (ret != LEPT_PARSE_OK)
             break;
-        memcpy((lept_member*)ctx.push(sizeof(lept_member)), &mem, sizeof(lept_member));
-        size++;
-        mem.k = nullptr; // ownership is transferred to member on stack 
 
-        lept_parse_whitespace(ctx);
-        if (*ctx.json == ',') {
-            ctx.json++;
+        // hand e to its parent, closing every container that e completes
+        for (;;) {
+            if (stack.empty()) {
+                memcpy(&v, &e, sizeof(e));
+                return LEPT_PARSE_OK;
+            }
+            lept_frame &f = stack.back();
+            if (f.size >= max_size_) { // the container's 32-bit size would overflow
+                lept_free(e);
+                ret = LEPT_PARSE_VALUE_TOO_LARGE;
+                break;
+            }
+            if (f.type == LEPT_ARRAY || shapes) {
+                memcpy((lept_value*)ctx.push(sizeof(lept_value)), &e, sizeof(e)); // push one element to stack
+            }
+            else {
+                auto *mem = (lept_member*)ctx.push(sizeof(lept_member));
+                mem->k = f.k; // ownership is transferred to member on stack
+                mem->klen = f.klen;
+                memcpy(&mem->v, &e, sizeof(e));
+                f.k = nullptr;
+            }
+            f.size++;
             lept_parse_whitespace(ctx);
-        }   
-        else if (*ctx.json == '}') {
+            if (*ctx.json == ',') {
+                ctx.json++;
+                lept_parse_whitespace(ctx);
+                if (f.type == LEPT_OBJECT &&
+                    (ret = lept_parse_key<parseFlags>(ctx, f, proj, skip_depth())) == LEPT_PARSE_OBJECT_END) {
+                    ret = LEPT_PARSE_OK;
+                    lept_parse_end(ctx, e, f, shapes);
+                    stack.pop_back();
+                    continue;
+                }
+                break;
+            }
+            if (*ctx.json != (f.type == LEPT_ARRAY ? ']' : '}')) {
+                ret = (f.type == LEPT_ARRAY ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                                            : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+                break;
+            }
             ctx.json++;
-            v.type = LEPT_OBJECT;
-            v.u.obj.size = size;
-            v.u.obj.m = new lept_member[size];
-            size *= sizeof(lept_member);
-            memcpy(v.u.obj.m, (lept_member*)ctx.pop(size), size);
-            return LEPT_PARSE_OK;
+            lept_parse_end(ctx, e, f, shapes);
+            stack.pop_back();
         }
-        else {
-            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        if (ret != LEPT_PARSE_OK)
             break;
-        }
     }
-    //when parse object error; pop and free stack and key (char *)
-    if (mem.k) delete []mem.k;  //when object.key is parsed normally, but miss colon or other errors
-    for (int i = 0; i < size; ++i) {
-        auto *member = (lept_member*)ctx.pop(sizeof(lept_member));
-        delete []member->k; // free object.key space
-        lept_free(member->v);
+    // pop and free every unfinished container when parse error
+    for (; !stack.empty(); stack.pop_back()) {
+        lept_frame &f = stack.back();
+        if (f.k) delete []f.k; // key parsed, but its value is not
+        if (f.type == LEPT_OBJECT && shapes) {
+            const char *m = ctx.stack.get() + f.base;
+            for (size_t i = 0; i < f.size; m = lept_stacked_next(m), ++i)
+                lept_free(*lept_stacked_value(m));
+            ctx.top = f.base;
+            continue;
+        }
+        for (size_t i = 0; i < f.size; ++i) {
+            if (f.type == LEPT_ARRAY) {
+                lept_free(*(lept_value *)ctx.pop(sizeof(lept_value)));
+            }
+            else {
+                auto *member = (lept_member*)ctx.pop(sizeof(lept_member));
+                delete []member->k; // free object.key space
+                lept_free(member->v);
+            }
+        }
     }
     return ret;
 }
 
-int LeptJson::lept_parse_value(lept_context &ctx, lept_value &v)
-{
-    switch(*ctx.json) {
-        case 'n': return lept_parse_literal(ctx, v, "null", LEPT_NULL);
-        case 't': return lept_parse_literal(ctx, v, "true", LEPT_TRUE);
-        case 'f': return lept_parse_literal(ctx, v, "false", LEPT_FALSE);
-        case '"': return lept_parse_string(ctx, v);
-        case '[': return lept_parse_array(ctx, v);
-        case '{': return lept_parse_object(ctx, v);
-        case '\0': return LEPT_PARSE_EXPECT_VALUE;
-        default: return lept_parse_number(ctx, v);
-    }
-}
 
 
 
 
-int LeptJson::parse(const std::string &json)
+template <unsigned parseFlags>
+int LeptJson::parse(const char *json, size_t len, const LeptProjection *proj)
 {
     lept_context ctx;
-    ctx.json = json.c_str();
+    lept_shapes shapes;
+    assert(json[len] == '\0');
+    ctx.json = json;
     ctx.size = ctx.top = 0;
+    ctx.shapes = &shapes;
     int ret;
     lept_parse_init();
+    if (parseFlags & LEPT_PARSE_FLAG_LAZY_NUMBERS) {
+        // lazy numbers point into the source, so the document keeps its own copy
+        source_.reset(new char[len + 1]);
+        memcpy(source_.get(), json, len + 1);
+        ctx.json = source_.get();
+    }
     lept_parse_whitespace(ctx);
-    if ((ret = lept_parse_value(ctx, parsed_v_)) == LEPT_PARSE_OK) {
+    if ((ret = lept_parse_value<parseFlags>(ctx, parsed_v_, 0, proj)) == LEPT_PARSE_OK) {
         lept_parse_whitespace(ctx);
         if (*ctx.json != '\0') {
             lept_parse_init();
@@ -336,6 +919,23 @@ int LeptJson::parse(const std::string &json)
 
 }
 
+/*
+ * Every combination of parse flags gets its own copy of the parser, with the
+ * checks it does not need folded away at compile time.
+ */
+#define LEPT_INSTANTIATE_PARSE(flags) \
+    template int LeptJson::parse<(flags)>(const char *json, size_t len, const LeptProjection *proj); \
+    template int LeptJson::lept_parse_value<(flags)>(lept_context &ctx, lept_value &v, size_t depth, const LeptProjection *proj); \
+    template int LeptJson::lept_parse_literal<(flags)>(lept_context &ctx, lept_value &v, const char *literal, lept_type type); \
+    template int LeptJson::lept_parse_number<(flags)>(lept_context &ctx, lept_value &v); \
+    template int LeptJson::lept_parse_string_raw<(flags)>(lept_context &ctx, char **s, size_t &len);
+#define LEPT_INSTANTIATE_PARSE_2(flags) LEPT_INSTANTIATE_PARSE(flags) LEPT_INSTANTIATE_PARSE((flags) | 1)
+#define LEPT_INSTANTIATE_PARSE_4(flags) LEPT_INSTANTIATE_PARSE_2(flags) LEPT_INSTANTIATE_PARSE_2((flags) | 2)
+#define LEPT_INSTANTIATE_PARSE_8(flags) LEPT_INSTANTIATE_PARSE_4(flags) LEPT_INSTANTIATE_PARSE_4((flags) | 4)
+#define LEPT_INSTANTIATE_PARSE_16(flags) LEPT_INSTANTIATE_PARSE_8(flags) LEPT_INSTANTIATE_PARSE_8((flags) | 8)
+#define LEPT_INSTANTIATE_PARSE_32(flags) LEPT_INSTANTIATE_PARSE_16(flags) LEPT_INSTANTIATE_PARSE_16((flags) | 16)
+LEPT_INSTANTIATE_PARSE_32(0)
+
 char* LeptJson::stringify( size_t *length)
 {
     if (json_) {
@@ -356,111 +956,212 @@ char* LeptJson::stringify( size_t *length)
 
 }
 
-#define PUTS(ctx, s, len) memcpy((char*)ctx.push(len), s, len)
+/*
+ * Containers are walked with an explicit stack of (container, index) pairs, so
+ * the recursion depth of the document does not reach the native stack.
+ */
 void LeptJson::lept_stringify_value(lept_context &ctx, const lept_value &v)
 {
-    switch (v.type) {
-        case LEPT_NULL:  PUTS(ctx, "null", 4); break;
-        case LEPT_FALSE: PUTS(ctx, "false", 5); break;
-        case LEPT_TRUE:  PUTS(ctx, "true", 4); break;
-        case LEPT_STRING: lept_stringify_string(ctx, v.u.s.s, v.u.s.len); break;
-        case LEPT_NUMBER:
-            ctx.top -= 32 - sprintf((char*)ctx.push(32), "%.17g", v.u.num);
-            break;
-        case LEPT_ARRAY:
-            PUTC(ctx, '[');
-            for (size_t i = 0; i < v.u.a.size; ++i) {
-                if (i > 0)
+    struct frame { const lept_value *v; size_t i; };
+    std::vector<frame> stack;
+    const lept_value *cur = &v;
+    for (;;) {
+        switch (cur->type) {
+            case LEPT_NULL:  PUTS(ctx, "null", 4); break;
+            case LEPT_FALSE: PUTS(ctx, "false", 5); break;
+            case LEPT_TRUE:  PUTS(ctx, "true", 4); break;
+            case LEPT_STRING:
+                if (cur->flags & LEPT_VALUE_FLAG_NO_ESCAPE) {
+                    char *p = (char*)ctx.push(cur->u.s.len + 2);
+                    p[0] = p[cur->u.s.len + 1] = '"';
+                    memcpy(p + 1, cur->u.s.s, cur->u.s.len);
+                }
+                else
+                    lept_stringify_string(ctx, cur->u.s.s, cur->u.s.len);
+                break;
+            case LEPT_RAW: PUTS(ctx, cur->u.s.s, cur->u.s.len); break;
+            case LEPT_NUMBER:
+                if (cur->flags & LEPT_VALUE_FLAG_LAZY_NUMBER) {
+                    size_t len;
+                    const char *s = lept_value_get_number_lexeme(*cur, len);
+                    PUTS(ctx, s, len); // the source text, verbatim
+                }
+                else
+                    lept_stringify_number(ctx, cur->u.num);
+                break;
+            case LEPT_ARRAY:
+                PUTC(ctx, '[');
+                if (cur->u.a.size > 0) {
+                    stack.push_back(frame{cur, 0});
+                    cur = lept_value_get_array_element(*cur, 0);
+                    continue;
+                }
+                PUTC(ctx, ']');
+                break;
+            case LEPT_OBJECT:
+                PUTC(ctx, '{');
+                if (cur->u.obj.size > 0) {
+                    stack.push_back(frame{cur, 0});
+                    lept_stringify_string(ctx, lept_value_get_object_key(*cur, 0),
+                            lept_value_get_object_key_length(*cur, 0));
+                    PUTC(ctx, ':');
+                    cur = lept_value_get_object_value(*cur, 0);
+                    continue;
+                }
+                PUTC(ctx, '}');
+                break;
+        }
+        // cur is written: move on to its next sibling, closing finished containers
+        for (;;) {
+            if (stack.empty())
+                return;
+            frame &f = stack.back();
+            if (f.v->type == LEPT_ARRAY) {
+                if (++f.i < f.v->u.a.size) {
                     PUTC(ctx, ',');
-                lept_stringify_value(ctx, v.u.a.e[i]);
+                    cur = lept_value_get_array_element(*f.v, f.i);
+                    break;
+                }
+                PUTC(ctx, ']');
             }
-            PUTC(ctx, ']');
-            break;
-        case LEPT_OBJECT:
-            PUTC(ctx, '{');
-            for (size_t i = 0; i < v.u.obj.size; ++i) {
-                if (i > 0)
+            else {
+                if (++f.i < f.v->u.obj.size) {
                     PUTC(ctx, ',');
-                lept_stringify_string(ctx, lept_value_get_object_key(v, i),
-                        lept_value_get_object_key_length(v, i));
-                PUTC(ctx, ':');
-                lept_stringify_value(ctx, *lept_value_get_object_value(v, i));
+                    lept_stringify_string(ctx, lept_value_get_object_key(*f.v, f.i),
+                            lept_value_get_object_key_length(*f.v, f.i));
+                    PUTC(ctx, ':');
+                    cur = lept_value_get_object_value(*f.v, f.i);
+                    break;
+                }
+                PUTC(ctx, '}');
             }
-            PUTC(ctx, '}');
-            break;
+            stack.pop_back();
+        }
     }
 }
 
+void LeptJson::lept_stringify_number(lept_context &ctx, double num)
+{
+    ctx.top -= 32 - sprintf((char*)ctx.push(32), "%.17g", num);
+}
+
+/*
+ * Clean runs between chars that need escaping are copied with one memcpy each,
+ * and the stack only grows by what is actually written.
+ */
 void LeptJson::lept_stringify_string(lept_context &ctx, const char *s, const size_t len)
 {
     assert(s != nullptr);
     static char hex_char[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-    auto size = len * 6 + 2;
-    char *p = (char *)ctx.push(size); 
-    char *head = p;
-    *p++ = '"';
-    for (size_t i = 0; i < len; ++i) {
-        unsigned char ch = (unsigned char)s[i];
+    const char *end = s + len;
+    PUTC(ctx, '"');
+    for (;;) {
+        const char *q = lept_scan_escape(s, end);
+        if (q != s)
+            PUTS(ctx, s, q - s);
+        if (q == end)
+            break;
+        unsigned char ch = (unsigned char)*q;
+        char *p = (char *)ctx.push(2);
+        *p++ = '\\';
         switch (ch) {
-            case '\"': *p++ = '\\'; *p++ = '\"';  break;
-            case '\\': *p++ = '\\'; *p++ = '\\';  break;
-            case '\b': *p++ = '\\'; *p++ = 'b' ;  break;
-            case '\f': *p++ = '\\'; *p++ = 'f' ;  break;
-            case '\r': *p++ = '\\'; *p++ = 'r' ;  break;
-            case '\n': *p++ = '\\'; *p++ = 'n' ;  break;
-            case '\t': *p++ = '\\'; *p++ = 't' ;  break; 
+            case '\"': *p = '\"';  break;
+            case '\\': *p = '\\';  break;
+            case '\b': *p = 'b' ;  break;
+            case '\f': *p = 'f' ;  break;
+            case '\r': *p = 'r' ;  break;
+            case '\n': *p = 'n' ;  break;
+            case '\t': *p = 't' ;  break; 
             default:
-                if (ch < 0x20) {
-                    *p++ = '\\'; *p++ = 'u'; 
-                    *p++ = '0';  *p++ = '0';
-                    *p++ = hex_char[ch >>  4];
-                    *p++ = hex_char[ch & 0x0F];
-                }
-                else *p++ = s[i];
+                p = (char *)ctx.push(4) - 1;
+                *p++ = 'u'; 
+                *p++ = '0';  *p++ = '0';
+                *p++ = hex_char[ch >>  4];
+                *p++ = hex_char[ch & 0x0F];
         }
+        s = q + 1;
     }
-    *p++ = '"';
-    ctx.top -= size -(p - head);
+    PUTC(ctx, '"');
 }
 
-LeptJson::LeptJson() :json_(nullptr), length_(0)
+LeptJson::LeptJson() :json_(nullptr), length_(0), max_depth_(LEPT_PARSE_MAX_DEPTH), max_size_(LEPT_SIZE_MAX),
+    reclaimer_(nullptr)
 { 
     parsed_v_.type = LEPT_NULL; 
 }
 
 LeptJson::~LeptJson() 
 { 
-    lept_free(parsed_v_);
+    lept_release(parsed_v_);
     if (json_) delete []json_;
 }
 
+/*
+ * Nested arrays and objects are moved onto a work list before their parent's
+ * storage is released, so freeing a deep tree does not recurse.
+ */
 void LeptJson::lept_free(lept_value &v)
 {
-    switch (v.type) {
-        case LEPT_STRING: 
-            delete []v.u.s.s; 
-            break;
-        case LEPT_ARRAY:
-            for(size_t i = 0; i < v.u.a.size; ++i)
-                lept_free(v.u.a.e[i]);
-            delete []v.u.a.e;
-            break;
-        case LEPT_OBJECT:
-            for (int i = 0; i < v.u.obj.size; ++i) {
-                delete []v.u.obj.m[i].k;
-                lept_free(v.u.obj.m[i].v);
-            }
-            delete []v.u.obj.m;
-            break;
-        default: ;
-    }
+    std::vector<lept_value> pending;
+    lept_value cur = v;
     v.type = LEPT_NULL;
+    for (;;) {
+        switch (cur.type) {
+            case LEPT_STRING: 
+            case LEPT_RAW:
+                delete []cur.u.s.s; 
+                break;
+            case LEPT_ARRAY:
+                for (size_t i = 0; i < cur.u.a.size; ++i) {
+                    lept_value &e = cur.u.a.e[i];
+                    if (e.type == LEPT_STRING || e.type == LEPT_RAW) delete []e.u.s.s;
+                    else if (e.type == LEPT_ARRAY || e.type == LEPT_OBJECT) pending.push_back(e);
+                }
+                delete []cur.u.a.e;
+                break;
+            case LEPT_OBJECT:
+                if (cur.flags & LEPT_VALUE_FLAG_SHAPED) {
+                    lept_value *values = (lept_value*)(cur.u.shaped.p + 1);
+                    for (size_t i = 0; i < cur.u.shaped.size; ++i) {
+                        lept_value &e = values[i];
+                        if (e.type == LEPT_STRING || e.type == LEPT_RAW) delete []e.u.s.s;
+                        else if (e.type == LEPT_ARRAY || e.type == LEPT_OBJECT) pending.push_back(e);
+                    }
+                    lept_release_shape(*cur.u.shaped.p);
+                    delete [](char*)cur.u.shaped.p;
+                    break;
+                }
+                for (size_t i = 0; i < cur.u.obj.size; ++i) {
+                    lept_value &e = cur.u.obj.m[i].v;
+                    delete []cur.u.obj.m[i].k;
+                    if (e.type == LEPT_STRING || e.type == LEPT_RAW) delete []e.u.s.s;
+                    else if (e.type == LEPT_ARRAY || e.type == LEPT_OBJECT) pending.push_back(e);
+                }
+                delete []cur.u.obj.m;
+                break;
+            default: ;
+        }
+        if (pending.empty())
+            return;
+        cur = pending.back();
+        pending.pop_back();
+    }
+}
+
+// free v's tree, in the background when a reclaimer is attached
+void LeptJson::lept_release(lept_value &v)
+{
+    if (reclaimer_)
+        reclaimer_->retire(v);
+    else
+        lept_free(v);
 }
 
-inline void LeptJson::lept_parse_init()
+void LeptJson::lept_parse_init()
 {
-    lept_free(parsed_v_);
+    lept_release(parsed_v_);
     parsed_v_.type = LEPT_NULL; 
+    source_.reset();
     if (json_) delete []json_;
     json_ = nullptr;
     length_ = 0;
@@ -468,18 +1169,51 @@ inline void LeptJson::lept_parse_init()
 
 void LeptJson::set_string(const char *s, size_t len)
 {
+    lept_release(parsed_v_);
     lept_set_string(parsed_v_, s, len);
 }
 
+void LeptJson::set_raw(const char *json, size_t len)
+{
+    lept_release(parsed_v_);
+    lept_set_raw(parsed_v_, json, len);
+    // stringify() would otherwise hand back the output cached for the old value
+    if (json_) delete []json_;
+    json_ = nullptr;
+    length_ = 0;
+}
+
+void LeptJson::lept_set_raw(lept_value &v, const char *json, size_t len)
+{
+    lept_set_string(v, json, len);
+    v.type = LEPT_RAW;
+}
+
+int LeptJson::lept_expand_raw(lept_value &v)
+{
+    assert(v.type == LEPT_RAW);
+    LeptJson doc;
+    int ret = doc.parse(std::string(v.u.s.s, v.u.s.len));
+    if (ret != LEPT_PARSE_OK)
+        return ret;
+    lept_free(v);
+    v = doc.parsed_v_;  // the default parse keeps nothing the tree needs in doc
+    doc.parsed_v_.type = LEPT_NULL;
+    return LEPT_PARSE_OK;
+}
+
 void LeptJson::lept_set_string(lept_value &v, const char *s, size_t len)
 {
     assert(s != nullptr || len == 0);
+    assert(len <= LEPT_SIZE_MAX);
     lept_free(v);
     v.u.s.s = new char[len+1];
-    std::memcpy(v.u.s.s, s, len);
+    if (len > 0)
+        std::memcpy(v.u.s.s, s, len);
     v.u.s.s[len] = '\0';
     v.u.s.len = len;
     v.type = LEPT_STRING;
+    v.flags = 0;
 }
 
 
@@ -4,9 +4,14 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <type_traits>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
 
-enum lept_type
+enum lept_type : unsigned char
 {
     LEPT_NULL = 11,
     LEPT_TRUE,
@@ -14,26 +19,91 @@ enum lept_type
     LEPT_NUMBER,
     LEPT_STRING,
     LEPT_ARRAY,
-    LEPT_OBJECT
+    LEPT_OBJECT,
+    LEPT_RAW        // trusted JSON text, written out verbatim; see LeptJson::lept_set_raw()
+};
+
+enum lept_value_flags
+{
+    LEPT_VALUE_FLAG_NO_ESCAPE     = 1 << 0,  // string: nothing in it needs escaping when written out
+    LEPT_VALUE_FLAG_LAZY_NUMBER   = 1 << 1,  // number: u.lazy points at its text in the parsed source
+    LEPT_VALUE_FLAG_NUMBER_CACHED = 1 << 2,  // lazy number: u.lazy.num holds the converted value
+    LEPT_VALUE_FLAG_SHAPED        = 1 << 3   // object: keys live in a shared lept_shape, see u.shaped
 };
 
 struct lept_member;
+struct lept_shape;
+/*
+ * lept_value is kept at 16 bytes: lengths and sizes are 32-bit and the union is
+ * packed to 4-byte alignment, so the one-byte type tag fills the slot that used
+ * to be padding. Arrays of values are therefore a third smaller than before.
+ * `flags` holds per-type lept_value_flags and is only read for types that set it.
+ * A lazy number keeps the 48-bit address of its text in u.lazy.lo and `ext`,
+ * next to the double LeptJson::materialize_numbers() converts it to.
+ */
+#pragma pack(push, 4)
 struct lept_value
 {
-    union  {
+    union data {
         double num;
-        struct { lept_member *m; size_t size; } obj;
-        struct { char*       s ; size_t len ; } s;
-        struct { lept_value* e ; size_t size; } a;
+        struct { lept_member *m; uint32_t size; } obj;
+        struct { lept_shape **p; uint32_t size; } shaped;  // *p is the shape, the values follow it
+        struct { char*       s ; uint32_t len ; } s;       // also the text of a raw value
+        struct { lept_value* e ; uint32_t size; } a;
+        struct { double num; uint32_t lo; } lazy;
+
+        data() = default;
+        constexpr data(double num) : num(num) {}
+        constexpr data(char *s, uint32_t len) : s{s, len} {}
+        constexpr data(lept_value *e, uint32_t size) : a{e, size} {}
+        constexpr data(lept_member *m, uint32_t size) : obj{m, size} {}
     } u;
     lept_type type;
+    unsigned char flags;
+    uint16_t ext;
+
+    // trivial as ever; the constexpr constructor is for trees built at compile time (leptstatic.h)
+    lept_value() = default;
+    constexpr lept_value(data u, lept_type type, unsigned char flags = 0) : u(u), type(type), flags(flags), ext(0) {}
 };
+#pragma pack(pop)
+static_assert(sizeof(lept_value) == 16, "lept_value must stay 16 bytes");
+
+#define LEPT_SIZE_MAX UINT32_MAX
 
 struct lept_member
 {
-    char *k = nullptr; size_t klen;
+    char *k; size_t klen;
     lept_value v;
 };
+// so that new lept_member[n] leaves the array for the parser's memcpy instead of zero-filling it first
+static_assert(std::is_trivial<lept_member>::value, "lept_member must stay trivial");
+
+struct lept_key
+{
+    char *k; size_t klen;
+};
+
+/*
+ * The key sequence of objects parsed with LEPT_PARSE_FLAG_SHAPES, stored once
+ * for all objects that list the same keys in the same order. Such an object
+ * keeps a pointer to its shape followed by its values, so each of its members
+ * costs a lept_value instead of a lept_member. A shape is counted by the
+ * objects that use it and freed with the last one; it is not shared between
+ * documents.
+ */
+struct lept_shape
+{
+    size_t size, refs;
+    lept_key *keys;
+};
+
+// where one key was last found, so that objects of the same shape skip the search
+struct lept_key_cache
+{
+    const lept_shape *shape = nullptr;
+    size_t index = 0;
+};
 
 enum parse_return
 {
@@ -50,33 +120,121 @@ enum parse_return
     LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     LEPT_PARSE_MISS_KEY,
     LEPT_PARSE_MISS_COLON,
-    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    LEPT_PARSE_DEPTH_EXCEEDED,
+    LEPT_PARSE_TYPE_MISMATCH,
+    LEPT_PARSE_MISS_FIELD,
+    LEPT_PARSE_INVALID_UTF8,
+    LEPT_PARSE_IO_ERROR,
+    LEPT_PARSE_VALUE_TOO_LARGE
 };
 
+/*
+ * Compile-time parser options, combined with | as the template argument of
+ * LeptJson::parse<flags>(). Each combination compiles to its own parser.
+ */
+enum lept_parse_flags
+{
+    LEPT_PARSE_FLAG_DEFAULT       = 0,
+    LEPT_PARSE_FLAG_TRUSTED       = 1 << 0,  // input is known to be valid: grammar, range and char checks are skipped
+    LEPT_PARSE_FLAG_NO_ESCAPES    = 1 << 1,  // strings carry no escapes: backslashes are kept verbatim
+    LEPT_PARSE_FLAG_VALIDATE_UTF8 = 1 << 2,  // reject strings that are not well-formed UTF-8
+    LEPT_PARSE_FLAG_LAZY_NUMBERS  = 1 << 3,  // keep numbers as their source text, converted on access
+    LEPT_PARSE_FLAG_SHAPES        = 1 << 4,  // objects with the same key sequence share one copy of the keys
+    LEPT_PARSE_FLAG_ALL           = (1 << 5) - 1
+};
+
+#ifndef LEPT_PARSE_MAX_DEPTH
+#define LEPT_PARSE_MAX_DEPTH 1024
+#endif
+
+// objects with more keys are kept as plain member arrays by LEPT_PARSE_FLAG_SHAPES
+#ifndef LEPT_PARSE_SHAPE_MAX_SIZE
+#define LEPT_PARSE_SHAPE_MAX_SIZE 64
+#endif
+
+// true when s[0, len) is well-formed UTF-8
+bool lept_validate_utf8(const char *s, size_t len);
+
+/*
+ * Numbers parsed with LEPT_PARSE_FLAG_LAZY_NUMBERS are converted from their
+ * text on every access; reads never write to the tree, so a const tree can be
+ * read from any number of threads. LeptJson::materialize_numbers() converts
+ * them all once, for trees whose numbers are read repeatedly. Range is only
+ * checked by the conversion: an out-of-range number reads as +-HUGE_VAL, while
+ * stringify() still writes its text.
+ */
+inline double            lept_value_get_number(const lept_value &v);
+double                   lept_value_convert_number(const lept_value &v);
+// true when v is an integer that fits in int64_t; lazy numbers are read exactly
+bool                     lept_value_get_int64(const lept_value &v, int64_t &i);
+// source text of a lazy number, or nullptr for any other value
+const char*              lept_value_get_number_lexeme(const lept_value &v, size_t &len);
+/*
+ * The text of a raw value. A raw value answers no other accessor, not even
+ * those of the type its text holds: they assert on LEPT_RAW. Callers that
+ * want to read into it call LeptJson::lept_expand_raw() first.
+ */
+inline const char*       lept_value_get_raw(const lept_value &v, size_t &len);
+inline const char*       lept_value_get_string(const lept_value &v);
+inline size_t            lept_value_get_string_length(const lept_value &v);
 inline size_t            lept_value_get_array_size(const lept_value &v);
 inline lept_value*       lept_value_get_array_element(const lept_value &v, size_t index);
 inline size_t            lept_value_get_object_size(const lept_value &v);
 inline size_t            lept_value_get_object_key_length(const lept_value &v, size_t index);
 inline const char*       lept_value_get_object_key(const lept_value &v, size_t index);
 inline const lept_value* lept_value_get_object_value(const lept_value &v, size_t index);
+// the shape of an object parsed with LEPT_PARSE_FLAG_SHAPES, or nullptr
+inline const lept_shape* lept_value_get_object_shape(const lept_value &v);
+/*
+ * Index of the member `key`, or the object size when there is none. With a
+ * cache, an object of the shape the cache last saw is answered without a
+ * search. A cache serves one key and must not be used across documents.
+ */
+size_t lept_value_find_object_index(const lept_value &v, const char *key, size_t klen,
+                                    lept_key_cache *cache = nullptr);
 
 
+class LeptReclaimer;
+class LeptProjection;
 class LeptJson
 {
   public:
     LeptJson();
     ~LeptJson();
-    int parse(const std::string &json);
+    int parse(const std::string &json) { return parse<LEPT_PARSE_FLAG_DEFAULT>(json); }
+    // builds only the object members selected by proj
+    int parse(const std::string &json, const LeptProjection &proj) { return parse<LEPT_PARSE_FLAG_DEFAULT>(json, &proj); }
+    template <unsigned parseFlags> int parse(const std::string &json, const LeptProjection *proj = nullptr)
+                                       { return parse<parseFlags>(json.c_str(), json.size(), proj); }
+    // json[len] must be '\0'
+    int parse(const char *json, size_t len) { return parse<LEPT_PARSE_FLAG_DEFAULT>(json, len); }
+    template <unsigned parseFlags> int parse(const char *json, size_t len, const LeptProjection *proj = nullptr);
+    // same result as parse(), with the elements of a large root array parsed by `threads` threads (0: one per core)
+    int parse_parallel(const std::string &json, unsigned threads = 0) { return parse_parallel<LEPT_PARSE_FLAG_DEFAULT>(json, threads); }
+    template <unsigned parseFlags> int parse_parallel(const std::string &json, unsigned threads = 0);
     char* stringify( size_t *length = nullptr);
+    // same output as stringify(), with large containers written by `threads` threads (0: one per core)
+    char* stringify_parallel(size_t *length = nullptr, unsigned threads = 0);
+
+    // hand freed trees to r instead of freeing them on the calling thread; nullptr frees inline
+    void set_reclaimer(LeptReclaimer *r) { reclaimer_ = r; }
+    // arrays and objects nested deeper than `depth` fail with LEPT_PARSE_DEPTH_EXCEEDED
+    void set_max_depth(size_t depth)    { max_depth_ = depth; }
+    // strings of more than `size` bytes and containers of more than `size` elements fail with
+    // LEPT_PARSE_VALUE_TOO_LARGE; the limit never exceeds LEPT_SIZE_MAX, what the 32-bit fields hold
+    void set_max_size(size_t size)      { max_size_ = size < LEPT_SIZE_MAX ? size : LEPT_SIZE_MAX; }
 
     void set_type(const lept_type nt)   {  parsed_v_.type = nt; }
     void set_null()                     { parsed_v_.type = LEPT_NULL;}
     void set_boolean(unsigned char b)   { parsed_v_.type = ( b ? LEPT_TRUE : LEPT_FALSE) ;}
-    void set_number(double n)           { parsed_v_.type = LEPT_NUMBER; parsed_v_.u.num = n; }
+    void set_number(double n)           { parsed_v_.type = LEPT_NUMBER; parsed_v_.flags = 0; parsed_v_.u.num = n; }
     void set_string(const char *s, size_t len);
+    void set_raw(const char *json, size_t len);
     
     lept_type   get_type() const        { return parsed_v_.type; }
-    double      get_number() const      { assert(parsed_v_.type == LEPT_NUMBER); return parsed_v_.u.num; }
+    const lept_value& get_value() const { return parsed_v_; }
+    double      get_number() const      { return lept_value_get_number(parsed_v_); }
     int         get_boolean() const;    
     const char* get_string() const;
     size_t      get_string_length() const;
@@ -86,39 +244,118 @@ class LeptJson
     size_t      get_object_key_length(size_t id) const { return lept_value_get_object_key_length(parsed_v_, id); }
     const char* get_object_key(size_t id) const        { return lept_value_get_object_key(parsed_v_, id); }
     const lept_value* get_object_value(size_t id) const {return lept_value_get_object_value(parsed_v_, id); }
+    size_t      find_object_index(const char *key, size_t klen) const { return lept_value_find_object_index(parsed_v_, key, klen); }
 
-    void        clear()                 { lept_free(parsed_v_); }
+    void        clear()                 { lept_release(parsed_v_); }
+    // converts every lazy number once and keeps the result next to its text
+    void        materialize_numbers();
+
+    static void lept_free(lept_value &v);
+    /*
+     * A raw value holds the text of one JSON value, trusted to be valid and
+     * not checked. Every stringify path copies it out verbatim, so wrapping an
+     * already serialized fragment costs a copy in and a copy out instead of a
+     * parse and a stringify. It is only parsed when lept_expand_raw() turns it
+     * into the tree it stands for, or when it is hashed or compared. Until
+     * then the get_* accessors assert on it, as on any value of another type.
+     */
+    static void lept_set_raw(lept_value &v, const char *json, size_t len);
+    // parses a raw value in place; on a parse error v is left raw and the error returned
+    static int  lept_expand_raw(lept_value &v);
 
   private:
+    friend class LeptBindReader;
+    friend class LeptBindWriter;
+    friend class LeptSnapshot;
+    friend class LeptWriter;
+
+    // the shapes met so far in one parse, by a hash of their key sequence
+    struct lept_shapes {
+        std::unordered_map<uint64_t, std::vector<lept_shape*> > table;
+
+        ~lept_shapes();
+        lept_shape* intern(const char *members, size_t n);
+    };
     struct lept_context {
         const char *json;
         std::shared_ptr<char> stack;
         size_t size, top;
+        lept_shapes *shapes;    // only read by parsers with LEPT_PARSE_FLAG_SHAPES
 
         void* push(size_t count);
         void* pop(size_t count);
     };
+    struct lept_piece;
+    // an array or object whose elements are being parsed
+    struct lept_frame {
+        lept_type type;
+        size_t size;            // elements (or members) already pushed on the stack
+        char *k; size_t klen;   // key of the member whose value is being parsed
+        size_t proj, vproj;     // projection nodes of the container and of the value being parsed
+        size_t base;            // stack top when the container opened
+    };
     lept_value parsed_v_;
+    std::unique_ptr<char[]> source_;    // copy of the input that lazy numbers point into
     char *json_;
     size_t length_;
+    size_t max_depth_;
+    size_t max_size_;
+    LeptReclaimer *reclaimer_;
+
+    void lept_parse_init();
+    template <unsigned parseFlags>
+    int lept_parse_value(lept_context &ctx, lept_value &v, size_t depth = 0, const LeptProjection *proj = nullptr);
+    void lept_release(lept_value &v);
 
-    inline void lept_parse_init();
-    inline void lept_set_string(lept_value &v, const char *s, size_t len);
-    void lept_parse_whitespace(lept_context &ctx);
-    int lept_parse_value(lept_context &ctx, lept_value &v);
-    int lept_parse_literal(lept_context &ctx, lept_value &v, const std::string &literal, lept_type type);
-    int lept_parse_number(lept_context &ctx, lept_value &v);
-    int lept_parse_string(lept_context &ctx, lept_value &v);
-    int lept_parse_string_raw(lept_context &ctx, char **s, size_t &len);
-    int lept_parse_array(lept_context &ctx, lept_value &v);
-    int lept_parse_object(lept_context &ctx, lept_value &v);
-    const char* lept_parse_hex4(const char *json, unsigned &u);
-    void lept_encode_utf8(lept_context &ctx, unsigned u);
-    void lept_free(lept_value &v);
-    void lept_stringify_value(lept_context &ctx, const lept_value &v);
-    void lept_stringify_string(lept_context &ctx, const char *s, const size_t len);
+    static inline void lept_set_string(lept_value &v, const char *s, size_t len);
+    static void lept_parse_whitespace(lept_context &ctx);
+    template <unsigned parseFlags = LEPT_PARSE_FLAG_DEFAULT>
+    static int lept_parse_literal(lept_context &ctx, lept_value &v, const char *literal, lept_type type);
+    template <unsigned parseFlags = LEPT_PARSE_FLAG_DEFAULT>
+    static int lept_parse_number(lept_context &ctx, lept_value &v);
+    template <unsigned parseFlags> static int lept_parse_string(lept_context &ctx, lept_value &v);
+    template <unsigned parseFlags = LEPT_PARSE_FLAG_DEFAULT>
+    static int lept_parse_string_raw(lept_context &ctx, char **s, size_t &len);
+    template <unsigned parseFlags>
+    static int lept_parse_key(lept_context &ctx, lept_frame &f, const LeptProjection *proj, size_t skip_depth);
+    static void lept_parse_end(lept_context &ctx, lept_value &v, const lept_frame &f, lept_shapes *shapes = nullptr);
+    static int lept_skip_value(lept_context &ctx, size_t max_depth = LEPT_PARSE_MAX_DEPTH);
+    template <unsigned parseFlags> static const char* lept_parse_hex4(const char *json, unsigned &u);
+    static void lept_encode_utf8(lept_context &ctx, unsigned u);
+    static void lept_stringify_value(lept_context &ctx, const lept_value &v);
+    static void lept_stringify_number(lept_context &ctx, double num);
+    static void lept_stringify_string(lept_context &ctx, const char *s, const size_t len);
+    static void lept_plan_stringify(std::vector<lept_piece> &pieces, const lept_value &v, size_t tasks, size_t depth);
+    static void lept_stringify_piece(lept_context &ctx, const lept_piece &piece);
 };
 
+inline double lept_value_get_number(const lept_value &v)
+{
+    assert(v.type == LEPT_NUMBER);
+    if ((v.flags & (LEPT_VALUE_FLAG_LAZY_NUMBER | LEPT_VALUE_FLAG_NUMBER_CACHED)) == LEPT_VALUE_FLAG_LAZY_NUMBER)
+        return lept_value_convert_number(v);
+    return v.u.num;
+}
+
+inline const char* lept_value_get_string(const lept_value &v)
+{
+    assert(v.type == LEPT_STRING);
+    return v.u.s.s;
+}
+
+inline size_t lept_value_get_string_length(const lept_value &v)
+{
+    assert(v.type == LEPT_STRING);
+    return v.u.s.len;
+}
+
+inline const char* lept_value_get_raw(const lept_value &v, size_t &len)
+{
+    assert(v.type == LEPT_RAW);
+    len = v.u.s.len;
+    return v.u.s.s;
+}
+
 inline size_t lept_value_get_array_size(const lept_value &v) 
 { 
     assert(v.type == LEPT_ARRAY); 
@@ -142,6 +379,8 @@ inline size_t lept_value_get_object_key_length(const lept_value &v, size_t index
 {
     assert(v.type == LEPT_OBJECT);
     assert(v.u.obj.size > index);
+    if (v.flags & LEPT_VALUE_FLAG_SHAPED)
+        return (*v.u.shaped.p)->keys[index].klen;
     return v.u.obj.m[index].klen;
 }
 
@@ -149,6 +388,8 @@ inline const char* lept_value_get_object_key(const lept_value &v, size_t index)
 {
     assert(v.type == LEPT_OBJECT);
     assert(v.u.obj.size > index);
+    if (v.flags & LEPT_VALUE_FLAG_SHAPED)
+        return (*v.u.shaped.p)->keys[index].k;
     return v.u.obj.m[index].k;
 }
 
@@ -156,6 +397,14 @@ inline const lept_value* lept_value_get_object_value(const lept_value &v, size_t
 {
     assert(v.type == LEPT_OBJECT);
     assert(v.u.obj.size > index);
+    if (v.flags & LEPT_VALUE_FLAG_SHAPED)
+        return (const lept_value*)(v.u.shaped.p + 1) + index;
     return &v.u.obj.m[index].v;
 }
+
+inline const lept_shape* lept_value_get_object_shape(const lept_value &v)
+{
+    assert(v.type == LEPT_OBJECT);
+    return (v.flags & LEPT_VALUE_FLAG_SHAPED) ? *v.u.shaped.p : nullptr;
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "leptjson.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#ifndef LEPT_PARALLEL_TASKS_PER_THREAD
+#define LEPT_PARALLEL_TASKS_PER_THREAD 8    // chunks a large container is cut into, per thread
+#endif
+
+#ifndef LEPT_PARALLEL_SPLIT_DEPTH
+#define LEPT_PARALLEL_SPLIT_DEPTH 3         // how deep small containers are opened to find large ones
+#endif
+
+static unsigned lept_thread_count(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+// run task(i) for every i < count on `threads` threads
+template <typename Task>
+static void lept_run_parallel(size_t count, unsigned threads, const Task &task)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < count; )
+            task(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads && t < count; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+        t.join();
+}
+
+/*
+ * A piece of the output: either fixed text (brackets, separators and keys of
+ * opened containers) or the children [begin, end) of a container, written with
+ * the comma in front of every child but the container's first.
+ */
+struct LeptJson::lept_piece {
+    const lept_value *v;
+    size_t begin, end;
+    std::string text;
+};
+
+/*
+ * Containers with at least `tasks` children are cut into about `tasks` ranges;
+ * smaller ones near the root are opened so their large descendants can be cut.
+ */
+void LeptJson::lept_plan_stringify(std::vector<lept_piece> &pieces, const lept_value &v,
+                                   size_t tasks, size_t depth)
+{
+    size_t size = v.type == LEPT_ARRAY ? v.u.a.size : v.type == LEPT_OBJECT ? v.u.obj.size : 0;
+    if (size == 0 || depth >= LEPT_PARALLEL_SPLIT_DEPTH) {
+        pieces.push_back(lept_piece{&v, 0, 0, std::string()});
+        return;
+    }
+    bool is_array = (v.type == LEPT_ARRAY);
+    pieces.push_back(lept_piece{nullptr, 0, 0, is_array ? "[" : "{"});
+    if (size >= tasks) {
+        size_t chunk = (size + tasks - 1) / tasks;
+        for (size_t i = 0; i < size; i += chunk)
+            pieces.push_back(lept_piece{&v, i, i + chunk < size ? i + chunk : size, std::string()});
+    }
+    else {
+        // small container: open it so that large descendants can be split
+        for (size_t i = 0; i < size; ++i) {
+            std::string sep = (i > 0 ? "," : "");
+            if (!is_array) {
+                lept_context ctx;
+                ctx.size = ctx.top = 0;
+                lept_stringify_string(ctx, lept_value_get_object_key(v, i), lept_value_get_object_key_length(v, i));
+                sep.append(ctx.stack.get(), ctx.top);
+                sep += ':';
+            }
+            pieces.push_back(lept_piece{nullptr, 0, 0, sep});
+            lept_plan_stringify(pieces, is_array ? *lept_value_get_array_element(v, i)
+                                                 : *lept_value_get_object_value(v, i), tasks, depth + 1);
+        }
+    }
+    pieces.push_back(lept_piece{nullptr, 0, 0, is_array ? "]" : "}"});
+}
+
+void LeptJson::lept_stringify_piece(lept_context &ctx, const lept_piece &piece)
+{
+    if (!piece.v) {
+        if (!piece.text.empty())
+            memcpy(ctx.push(piece.text.size()), piece.text.data(), piece.text.size());
+        return;
+    }
+    if (piece.begin == piece.end) {
+        lept_stringify_value(ctx, *piece.v);
+        return;
+    }
+    for (size_t i = piece.begin; i < piece.end; ++i) {
+        if (i > 0)
+            *(char*)ctx.push(1) = ',';
+        if (piece.v->type == LEPT_ARRAY)
+            lept_stringify_value(ctx, *lept_value_get_array_element(*piece.v, i));
+        else {
+            lept_stringify_string(ctx, lept_value_get_object_key(*piece.v, i),
+                    lept_value_get_object_key_length(*piece.v, i));
+            *(char*)ctx.push(1) = ':';
+            lept_stringify_value(ctx, *lept_value_get_object_value(*piece.v, i));
+        }
+    }
+}
+
+/*
+ * Large arrays and objects are cut into chunks of children that are written
+ * into separate buffers by a pool of threads and then concatenated, so the
+ * output is byte-for-byte what stringify() produces.
+ */
+char* LeptJson::stringify_parallel(size_t *length, unsigned threads)
+{
+    if (json_) {
+        if (length) *length = length_;
+        return json_;
+    }
+    threads = lept_thread_count(threads);
+    size_t size = parsed_v_.type == LEPT_ARRAY ? parsed_v_.u.a.size :
+                  parsed_v_.type == LEPT_OBJECT ? parsed_v_.u.obj.size : 0;
+    if (threads == 1 || size == 0)
+        return stringify(length);
+
+    std::vector<lept_piece> pieces;
+    lept_plan_stringify(pieces, parsed_v_, threads * LEPT_PARALLEL_TASKS_PER_THREAD, 0);
+
+    std::vector<lept_context> out(pieces.size());
+    lept_run_parallel(pieces.size(), threads, [&](size_t i) {
+        out[i].size = out[i].top = 0;
+        lept_stringify_piece(out[i], pieces[i]);
+    });
+
+    length_ = 0;
+    for (auto &ctx : out)
+        length_ += ctx.top;
+    json_ = new char[length_ + 1];
+    char *p = json_;
+    for (auto &ctx : out) {
+        if (ctx.top > 0)
+            memcpy(p, ctx.stack.get(), ctx.top);
+        p += ctx.top;
+    }
+    json_[length_] = '\0';
+    if (length)
+        *length = length_;
+    return json_;
+}
+
+#ifndef LEPT_PARALLEL_MIN_CHUNK
+#define LEPT_PARALLEL_MIN_CHUNK (16 << 10)  // smallest slice of input handed to one scan task
+#endif
+
+/*
+ * Scans [p, end) for quotes and brackets starting in the given string state and
+ * returns the state at end; depth is moved by the brackets seen outside strings.
+ */
+template <bool escapes>
+static bool lept_scan_chunk(const char *p, const char *end, bool in_string, long &depth)
+{
+    for (; p < end; ++p) {
+        char ch = *p;
+        if (in_string) {
+            if (ch == '\"')
+                in_string = false;
+            else if (escapes && ch == '\\')
+                ++p;
+        }
+        else if (ch == '\"')
+            in_string = true;
+        else if (ch == '[' || ch == '{')
+            ++depth;
+        else if (ch == ']' || ch == '}')
+            --depth;
+    }
+    return in_string;
+}
+
+// the first comma in [p, end) that separates two elements of the root array, or nullptr
+template <bool escapes>
+static const char* lept_find_split(const char *p, const char *end, bool in_string, long depth)
+{
+    for (; p < end; ++p) {
+        char ch = *p;
+        if (in_string) {
+            if (ch == '\"')
+                in_string = false;
+            else if (escapes && ch == '\\')
+                ++p;
+        }
+        else if (ch == '\"')
+            in_string = true;
+        else if (ch == '[' || ch == '{')
+            ++depth;
+        else if (ch == ']' || ch == '}')
+            --depth;
+        else if (ch == ',' && depth == 1)
+            return p;
+    }
+    return nullptr;
+}
+
+/*
+ * The input is cut into chunks whose string state and bracket depth are first
+ * worked out for both possible starting states in parallel, then resolved from
+ * left to right. Each chunk then looks for its first comma between root array
+ * elements, and the elements between consecutive commas are parsed by separate
+ * threads and stitched into one array. Chunks never start right after a
+ * backslash, so an escape is never split from the character it escapes.
+ *
+ * Anything that does not parse cleanly is parsed again by parse(), so errors
+ * are reported exactly as the sequential parser reports them.
+ */
+template <unsigned parseFlags>
+int LeptJson::parse_parallel(const std::string &json, unsigned threads)
+{
+    const bool escapes = !(parseFlags & LEPT_PARSE_FLAG_NO_ESCAPES);
+    std::unique_ptr<char[]> source;
+    const char *begin = json.c_str(), *end = begin + json.size();
+    if (parseFlags & LEPT_PARSE_FLAG_LAZY_NUMBERS) {
+        source.reset(new char[json.size() + 1]);
+        memcpy(source.get(), begin, json.size() + 1);
+        begin = source.get();
+        end = begin + json.size();
+    }
+    const char *root = begin;
+    while (*root == ' ' || *root == '\t' || *root == '\n' || *root == '\r')
+        ++root;
+    threads = lept_thread_count(threads);
+    size_t chunks = std::min<size_t>(threads * LEPT_PARALLEL_TASKS_PER_THREAD,
+                                     (end - root) / LEPT_PARALLEL_MIN_CHUNK);
+    if (threads == 1 || chunks < 2 || *root != '[' || max_depth_ == 0)
+        return parse<parseFlags>(json);
+
+    std::vector<const char*> cut(chunks + 1);
+    cut[0] = root;
+    cut[chunks] = end;
+    for (size_t k = 1; k < chunks; ++k) {
+        const char *p = root + (end - root) * k / chunks;
+        while (escapes && p < end && p[-1] == '\\')
+            ++p;
+        cut[k] = std::max(p, cut[k - 1]);
+    }
+
+    // state at the end of every chunk, for a start outside [0] and inside [1] a string
+    struct scan { bool in_string[2]; long depth[2]; };
+    std::vector<scan> scans(chunks);
+    lept_run_parallel(chunks, threads, [&](size_t k) {
+        for (int s = 0; s < 2; ++s) {
+            scans[k].depth[s] = 0;
+            scans[k].in_string[s] = escapes ? lept_scan_chunk<true>(cut[k], cut[k + 1], s, scans[k].depth[s])
+                                            : lept_scan_chunk<false>(cut[k], cut[k + 1], s, scans[k].depth[s]);
+        }
+    });
+    std::vector<bool> in_string(chunks);
+    std::vector<long> depth(chunks);
+    in_string[0] = false;
+    depth[0] = 0;
+    for (size_t k = 1; k < chunks; ++k) {
+        const scan &prev = scans[k - 1];
+        in_string[k] = prev.in_string[in_string[k - 1]];
+        depth[k] = depth[k - 1] + prev.depth[in_string[k - 1]];
+    }
+
+    std::vector<const char*> split(chunks, nullptr);
+    lept_run_parallel(chunks - 1, threads, [&](size_t i) {
+        size_t k = i + 1;
+        split[k] = escapes ? lept_find_split<true>(cut[k], cut[k + 1], in_string[k], depth[k])
+                           : lept_find_split<false>(cut[k], cut[k + 1], in_string[k], depth[k]);
+    });
+
+    // segment i holds the elements between bounds[i] and bounds[i + 1]
+    std::vector<const char*> bounds(1, root + 1);
+    for (size_t k = 1; k < chunks; ++k)
+        if (split[k])
+            bounds.push_back(split[k] + 1);
+    size_t segments = bounds.size();
+    bounds.push_back(nullptr);
+
+    std::vector<std::vector<lept_value> > elems(segments);
+    std::vector<int> status(segments, LEPT_PARSE_OK);
+    lept_run_parallel(segments, threads, [&](size_t i) {
+        lept_context ctx;
+        lept_shapes shapes;     // each segment finds its own shapes
+        ctx.json = bounds[i];
+        ctx.size = ctx.top = 0;
+        ctx.shapes = &shapes;
+        int ret;
+        for (;;) {
+            lept_value e;
+            lept_parse_whitespace(ctx);
+            if ((ret = lept_parse_value<parseFlags>(ctx, e, 1)) != LEPT_PARSE_OK)
+                break;
+            elems[i].push_back(e);
+            lept_parse_whitespace(ctx);
+            if (bounds[i + 1]) {
+                // every segment but the last ends right on the comma before the next one
+                if (ctx.json == bounds[i + 1] - 1)
+                    break;
+                if (*ctx.json != ',' || ctx.json > bounds[i + 1] - 1) {
+                    ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                    break;
+                }
+            }
+            else if (*ctx.json == ']') {
+                ctx.json++;
+                lept_parse_whitespace(ctx);
+                if (ctx.json != end)
+                    ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+                break;
+            }
+            else if (*ctx.json != ',') {
+                ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                break;
+            }
+            ctx.json++;
+        }
+        status[i] = ret;
+    });
+
+    size_t n = 0;
+    bool ok = true;
+    for (size_t i = 0; i < segments; ++i) {
+        n += elems[i].size();
+        ok = ok && status[i] == LEPT_PARSE_OK;
+    }
+    if (!ok || n > max_size_) {
+        for (auto &seg : elems)
+            for (auto &e : seg)
+                lept_free(e);
+        return parse<parseFlags>(json);
+    }
+
+    lept_parse_init();
+    source_ = std::move(source);
+    lept_value *e = new lept_value[n];
+    size_t at = 0;
+    for (auto &seg : elems) {
+        memcpy(e + at, seg.data(), seg.size() * sizeof(lept_value));
+        at += seg.size();
+    }
+    parsed_v_.type = LEPT_ARRAY;
+    parsed_v_.flags = 0;
+    parsed_v_.u.a.e = e;
+    parsed_v_.u.a.size = (uint32_t)n;
+    return LEPT_PARSE_OK;
+}
+
+#define LEPT_INSTANTIATE_PARSE_PARALLEL(flags) \
+    template int LeptJson::parse_parallel<(flags)>(const std::string &json, unsigned threads);
+#define LEPT_INSTANTIATE_PARSE_PARALLEL_2(flags) \
+    LEPT_INSTANTIATE_PARSE_PARALLEL(flags) LEPT_INSTANTIATE_PARSE_PARALLEL((flags) | 1)
+#define LEPT_INSTANTIATE_PARSE_PARALLEL_4(flags) \
+    LEPT_INSTANTIATE_PARSE_PARALLEL_2(flags) LEPT_INSTANTIATE_PARSE_PARALLEL_2((flags) | 2)
+#define LEPT_INSTANTIATE_PARSE_PARALLEL_8(flags) \
+    LEPT_INSTANTIATE_PARSE_PARALLEL_4(flags) LEPT_INSTANTIATE_PARSE_PARALLEL_4((flags) | 4)
+#define LEPT_INSTANTIATE_PARSE_PARALLEL_16(flags) \
+    LEPT_INSTANTIATE_PARSE_PARALLEL_8(flags) LEPT_INSTANTIATE_PARSE_PARALLEL_8((flags) | 8)
+#define LEPT_INSTANTIATE_PARSE_PARALLEL_32(flags) \
+    LEPT_INSTANTIATE_PARSE_PARALLEL_16(flags) LEPT_INSTANTIATE_PARSE_PARALLEL_16((flags) | 16)
+LEPT_INSTANTIATE_PARSE_PARALLEL_32(0)
@@ -0,0 +1,44 @@
+#include "leptprojection.h"
+
+LeptProjection::LeptProjection() : nodes_(1)
+{
+    nodes_[0].whole = false;
+}
+
+LeptProjection& LeptProjection::select(const std::string &path)
+{
+    std::vector<std::string> keys;
+    size_t start = 0, dot;
+    while ((dot = path.find('.', start)) != std::string::npos) {
+        keys.push_back(path.substr(start, dot - start));
+        start = dot + 1;
+    }
+    keys.push_back(path.substr(start));
+    return select(keys);
+}
+
+LeptProjection& LeptProjection::select(const std::vector<std::string> &keys)
+{
+    size_t n = 0;
+    for (const auto &key : keys) {
+        size_t i = 0;
+        for (; i < nodes_[n].children.size() && nodes_[n].children[i].first != key; ++i) ;
+        if (i == nodes_[n].children.size()) {
+            nodes_.push_back(node());
+            nodes_.back().whole = false;
+            nodes_[n].children.push_back(std::make_pair(key, nodes_.size() - 1));
+        }
+        n = nodes_[n].children[i].second;
+    }
+    nodes_[n].whole = true;
+    return *this;
+}
+
+size_t LeptProjection::find(size_t n, const char *key, size_t klen) const
+{
+    assert(n < nodes_.size());
+    for (const auto &c : nodes_[n].children)
+        if (c.first.size() == klen && memcmp(c.first.data(), key, klen) == 0)
+            return nodes_[c.second].whole ? LEPT_PROJECTION_ALL : c.second;
+    return LEPT_PROJECTION_NONE;
+}
@@ -0,0 +1,41 @@
+#ifndef LEPT_PROJECTION_H__
+#define LEPT_PROJECTION_H__
+
+#include "leptjson.h"
+
+#define LEPT_PROJECTION_ALL  ((size_t)-1)   // the whole subtree is selected
+#define LEPT_PROJECTION_NONE ((size_t)-2)   // nothing in the subtree is selected
+
+/*
+ * A compiled set of key paths for LeptJson::parse(json, projection).
+ *
+ *     LeptProjection p;
+ *     p.select("id").select("user.name");
+ *
+ * Only the selected members of objects are built; every other member is
+ * skipped by a bracket- and string-aware scan that allocates nothing and
+ * converts no numbers (so the skipped text is not validated either).
+ * Arrays are transparent: the projection applies to each of their elements.
+ * A selected path that ends early at a scalar keeps the scalar.
+ */
+class LeptProjection
+{
+  public:
+    LeptProjection();
+
+    LeptProjection& select(const std::string &path);              // keys separated by '.'
+    LeptProjection& select(const std::vector<std::string> &keys);
+
+    size_t root() const { return nodes_[0].whole ? LEPT_PROJECTION_ALL : 0; }
+    // the node selecting the member `key` of an object at `node`
+    size_t find(size_t node, const char *key, size_t klen) const;
+
+  private:
+    struct node {
+        std::vector<std::pair<std::string, size_t> > children;
+        bool whole;
+    };
+    std::vector<node> nodes_;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "leptreclaimer.h"
+
+LeptReclaimer::LeptReclaimer(size_t capacity)
+    : ring_(capacity > 0 ? capacity : 1), head_(0), count_(0), busy_(false), stop_(false)
+{
+    worker_ = std::thread(&LeptReclaimer::run, this);
+}
+
+LeptReclaimer::~LeptReclaimer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    worker_.join();
+}
+
+void LeptReclaimer::retire(lept_value &v)
+{
+    if (v.type != LEPT_STRING && v.type != LEPT_RAW && v.type != LEPT_ARRAY && v.type != LEPT_OBJECT) {
+        v.type = LEPT_NULL;
+        return;
+    }
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ < ring_.size()) {
+            ring_[(head_ + count_++) % ring_.size()] = v;
+            queued = true;
+        }
+    }
+    if (queued) {
+        v.type = LEPT_NULL;
+        work_.notify_one();
+    }
+    else
+        LeptJson::lept_free(v); // queue is full
+}
+
+void LeptReclaimer::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return count_ == 0 && !busy_; });
+}
+
+size_t LeptReclaimer::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_ + (busy_ ? 1 : 0);
+}
+
+// take everything queued at once and free the batch outside the lock
+void LeptReclaimer::run()
+{
+    std::vector<lept_value> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_.wait(lock, [this] { return count_ > 0 || stop_; });
+        if (count_ == 0)
+            break; // stopped and drained
+        for (; count_ > 0; --count_, head_ = (head_ + 1) % ring_.size())
+            batch.push_back(ring_[head_]);
+        busy_ = true;
+        lock.unlock();
+        for (auto &v : batch)
+            LeptJson::lept_free(v);
+        batch.clear();
+        lock.lock();
+        busy_ = false;
+        idle_.notify_all();
+    }
+}
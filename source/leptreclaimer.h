@@ -0,0 +1,41 @@
+#ifndef LEPT_RECLAIMER_H__
+#define LEPT_RECLAIMER_H__
+
+#include "leptjson.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef LEPT_RECLAIMER_QUEUE_SIZE
+#define LEPT_RECLAIMER_QUEUE_SIZE 1024
+#endif
+
+/*
+ * Frees retired value trees on a background thread.
+ * retire() only moves the 16-byte root into a fixed-size ring, so it returns
+ * without walking the tree; when the ring is full the tree is freed on the
+ * calling thread instead, which keeps the queue memory bounded.
+ * A reclaimer must outlive every LeptJson it is attached to.
+ */
+class LeptReclaimer
+{
+  public:
+    explicit LeptReclaimer(size_t capacity = LEPT_RECLAIMER_QUEUE_SIZE);
+    ~LeptReclaimer();
+
+    void   retire(lept_value &v);   // takes ownership of v's tree, v becomes null
+    void   flush();                 // blocks until every retired tree is freed
+    size_t pending() const;
+
+  private:
+    std::vector<lept_value> ring_;
+    size_t head_, count_;
+    bool busy_, stop_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_, idle_;
+    std::thread worker_;
+
+    void run();
+};
+
+#endif
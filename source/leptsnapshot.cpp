@@ -0,0 +1,308 @@
+#include "leptsnapshot.h"
+
+struct LeptSnapshot::node
+{
+    lept_type type;
+    double num;
+    std::string str;                   // string, raw text, or the source text of a lazy number
+    std::vector<LeptSnapshot> items;   // array elements or member values
+    // member keys, objects only; immutable, so versions that keep the same keys share them
+    std::shared_ptr<const std::vector<std::string> > keys;
+
+    explicit node(lept_type t) : type(t), num(0) {}
+    ~node();
+};
+
+/*
+ * Children held by this node alone are detached and freed one at a time, so
+ * releasing a deep tree does not recurse once per level.
+ */
+LeptSnapshot::node::~node()
+{
+    std::vector<std::shared_ptr<const node> > pending;
+    for (auto &c : items)
+        if (c.n_.use_count() == 1)
+            pending.push_back(std::move(c.n_));
+    while (!pending.empty()) {
+        std::shared_ptr<const node> n = std::move(pending.back());
+        pending.pop_back();
+        for (auto &c : const_cast<node&>(*n).items)
+            if (c.n_.use_count() == 1)
+                pending.push_back(std::move(c.n_));
+    }
+}
+
+// the tree is copied top-down with a work list of (source, destination slot) pairs
+LeptSnapshot::LeptSnapshot(const lept_value &v)
+{
+    std::vector<std::pair<const lept_value*, LeptSnapshot*> > todo(1, std::make_pair(&v, this));
+    while (!todo.empty()) {
+        const lept_value &src = *todo.back().first;
+        LeptSnapshot *dst = todo.back().second;
+        todo.pop_back();
+        if (src.type == LEPT_NULL)
+            continue;
+        std::shared_ptr<node> n = std::make_shared<node>(src.type);
+        switch (src.type) {
+            case LEPT_NUMBER: {
+                size_t len;
+                const char *lexeme = lept_value_get_number_lexeme(src, len);
+                n->num = lept_value_get_number(src);
+                if (lexeme)
+                    n->str.assign(lexeme, len); // written verbatim, as LeptJson does
+                break;
+            }
+            case LEPT_STRING:
+            case LEPT_RAW: n->str.assign(src.u.s.s, src.u.s.len); break;
+            case LEPT_ARRAY:
+                n->items.resize(src.u.a.size);
+                for (size_t i = 0; i < src.u.a.size; ++i)
+                    todo.push_back(std::make_pair(&src.u.a.e[i], &n->items[i]));
+                break;
+            case LEPT_OBJECT: {
+                std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >();
+                n->items.resize(src.u.obj.size);
+                keys->reserve(src.u.obj.size);
+                for (size_t i = 0; i < src.u.obj.size; ++i) {
+                    keys->emplace_back(lept_value_get_object_key(src, i), lept_value_get_object_key_length(src, i));
+                    todo.push_back(std::make_pair(lept_value_get_object_value(src, i), &n->items[i]));
+                }
+                n->keys = std::move(keys);
+                break;
+            }
+            default: break;
+        }
+        dst->n_ = std::move(n);
+    }
+}
+
+LeptSnapshot LeptSnapshot::boolean(bool b)
+{
+    return LeptSnapshot(std::make_shared<node>(b ? LEPT_TRUE : LEPT_FALSE));
+}
+
+LeptSnapshot LeptSnapshot::number(double num)
+{
+    std::shared_ptr<node> n = std::make_shared<node>(LEPT_NUMBER);
+    n->num = num;
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::string(const char *s, size_t len)
+{
+    assert(s != nullptr || len == 0);
+    std::shared_ptr<node> n = std::make_shared<node>(LEPT_STRING);
+    n->str.assign(s, len);
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::raw(const char *json, size_t len)
+{
+    assert(json != nullptr || len == 0);
+    std::shared_ptr<node> n = std::make_shared<node>(LEPT_RAW);
+    n->str.assign(json, len);
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::array()
+{
+    return LeptSnapshot(std::make_shared<node>(LEPT_ARRAY));
+}
+
+LeptSnapshot LeptSnapshot::object()
+{
+    std::shared_ptr<node> n = std::make_shared<node>(LEPT_OBJECT);
+    n->keys = std::make_shared<const std::vector<std::string> >();
+    return LeptSnapshot(std::move(n));
+}
+
+lept_type LeptSnapshot::get_type() const
+{
+    return n_ ? n_->type : LEPT_NULL;
+}
+
+int LeptSnapshot::get_boolean() const
+{
+    assert(get_type() == LEPT_TRUE || get_type() == LEPT_FALSE);
+    return n_->type;
+}
+
+double LeptSnapshot::get_number() const
+{
+    assert(get_type() == LEPT_NUMBER);
+    return n_->num;
+}
+
+const char* LeptSnapshot::get_string() const
+{
+    assert(get_type() == LEPT_STRING);
+    return n_->str.c_str();
+}
+
+size_t LeptSnapshot::get_string_length() const
+{
+    assert(get_type() == LEPT_STRING);
+    return n_->str.size();
+}
+
+size_t LeptSnapshot::get_array_size() const
+{
+    assert(get_type() == LEPT_ARRAY);
+    return n_->items.size();
+}
+
+LeptSnapshot LeptSnapshot::get_array_element(size_t index) const
+{
+    assert(get_type() == LEPT_ARRAY);
+    assert(index < n_->items.size());
+    return n_->items[index];
+}
+
+size_t LeptSnapshot::get_object_size() const
+{
+    assert(get_type() == LEPT_OBJECT);
+    return n_->items.size();
+}
+
+const char* LeptSnapshot::get_object_key(size_t index) const
+{
+    assert(get_type() == LEPT_OBJECT);
+    assert(index < n_->keys->size());
+    return (*n_->keys)[index].c_str();
+}
+
+size_t LeptSnapshot::get_object_key_length(size_t index) const
+{
+    assert(get_type() == LEPT_OBJECT);
+    assert(index < n_->keys->size());
+    return (*n_->keys)[index].size();
+}
+
+LeptSnapshot LeptSnapshot::get_object_value(size_t index) const
+{
+    assert(get_type() == LEPT_OBJECT);
+    assert(index < n_->items.size());
+    return n_->items[index];
+}
+
+size_t LeptSnapshot::find_object_index(const char *key, size_t klen) const
+{
+    assert(get_type() == LEPT_OBJECT);
+    const std::vector<std::string> &keys = *n_->keys;
+    size_t i = 0;
+    for (; i < keys.size(); ++i)
+        if (keys[i].size() == klen && memcmp(keys[i].data(), key, klen) == 0)
+            break;
+    return i;
+}
+
+/*
+ * Every update copies only the container it changes: the new node gets a copy
+ * of the child pointer list, so the children themselves stay shared. Keys are
+ * shared too, and copied only when a member is added or removed.
+ */
+LeptSnapshot LeptSnapshot::with_element(size_t index, const LeptSnapshot &e) const
+{
+    assert(get_type() == LEPT_ARRAY);
+    assert(index < n_->items.size());
+    std::shared_ptr<node> n = std::make_shared<node>(*n_);
+    n->items[index] = e;
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::with_appended(const LeptSnapshot &e) const
+{
+    assert(get_type() == LEPT_ARRAY);
+    std::shared_ptr<node> n = std::make_shared<node>(*n_);
+    n->items.push_back(e);
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::with_member(const char *key, size_t klen, const LeptSnapshot &v) const
+{
+    size_t i = find_object_index(key, klen);
+    std::shared_ptr<node> n = std::make_shared<node>(*n_);
+    if (i < n->items.size())
+        n->items[i] = v;
+    else {
+        std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >(*n->keys);
+        keys->emplace_back(key, klen);
+        n->keys = std::move(keys);
+        n->items.push_back(v);
+    }
+    return LeptSnapshot(std::move(n));
+}
+
+LeptSnapshot LeptSnapshot::without_member(const char *key, size_t klen) const
+{
+    size_t i = find_object_index(key, klen);
+    if (i == n_->items.size())
+        return *this;
+    std::shared_ptr<node> n = std::make_shared<node>(*n_);
+    std::shared_ptr<std::vector<std::string> > keys = std::make_shared<std::vector<std::string> >(*n->keys);
+    keys->erase(keys->begin() + i);
+    n->keys = std::move(keys);
+    n->items.erase(n->items.begin() + i);
+    return LeptSnapshot(std::move(n));
+}
+
+/*
+ * Same output as LeptJson::stringify() for the same value. Only reads the
+ * nodes, so many threads may stringify one snapshot at once.
+ */
+std::string LeptSnapshot::stringify() const
+{
+    struct frame { const node *n; size_t i; };
+    std::vector<frame> stack;
+    LeptJson::lept_context ctx;
+    ctx.size = ctx.top = 0;
+    const node *cur = n_.get();
+    for (;;) {
+        switch (cur ? cur->type : LEPT_NULL) {
+            case LEPT_NULL:  memcpy(ctx.push(4), "null", 4); break;
+            case LEPT_TRUE:  memcpy(ctx.push(4), "true", 4); break;
+            case LEPT_FALSE: memcpy(ctx.push(5), "false", 5); break;
+            case LEPT_NUMBER:
+                if (!cur->str.empty())
+                    memcpy(ctx.push(cur->str.size()), cur->str.data(), cur->str.size());
+                else
+                    LeptJson::lept_stringify_number(ctx, cur->num);
+                break;
+            case LEPT_STRING: LeptJson::lept_stringify_string(ctx, cur->str.data(), cur->str.size()); break;
+            case LEPT_RAW: memcpy(ctx.push(cur->str.size()), cur->str.data(), cur->str.size()); break;
+            case LEPT_ARRAY:
+            case LEPT_OBJECT:
+                *(char*)ctx.push(1) = (cur->type == LEPT_ARRAY ? '[' : '{');
+                if (!cur->items.empty()) {
+                    stack.push_back(frame{cur, 0});
+                    if (cur->type == LEPT_OBJECT) {
+                        const std::string &k = (*cur->keys)[0];
+                        LeptJson::lept_stringify_string(ctx, k.data(), k.size());
+                        *(char*)ctx.push(1) = ':';
+                    }
+                    cur = cur->items[0].n_.get();
+                    continue;
+                }
+                *(char*)ctx.push(1) = (cur->type == LEPT_ARRAY ? ']' : '}');
+                break;
+        }
+        // the value is complete: move on to its next sibling, closing finished containers
+        for (;;) {
+            if (stack.empty())
+                return std::string(ctx.stack.get(), ctx.top);
+            frame &f = stack.back();
+            if (++f.i < f.n->items.size()) {
+                *(char*)ctx.push(1) = ',';
+                if (f.n->type == LEPT_OBJECT) {
+                    const std::string &k = (*f.n->keys)[f.i];
+                    LeptJson::lept_stringify_string(ctx, k.data(), k.size());
+                    *(char*)ctx.push(1) = ':';
+                }
+                cur = f.n->items[f.i].n_.get();
+                break;
+            }
+            *(char*)ctx.push(1) = (f.n->type == LEPT_ARRAY ? ']' : '}');
+            stack.pop_back();
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef LEPT_SNAPSHOT_H__
+#define LEPT_SNAPSHOT_H__
+
+#include "leptjson.h"
+#include <atomic>
+
+/*
+ * An immutable, reference-counted JSON value. Copies share the same nodes, and
+ * since nodes never change after they are built any number of threads may
+ * read a snapshot at the same time without locking.
+ *
+ * Updates are copy-on-write: with_element(), with_member() and friends return
+ * a new snapshot in which only the nodes on the path to the change are new;
+ * every other subtree is shared with the original, which is left untouched.
+ *
+ *     LeptSnapshot doc(json);                      // copy of a parsed document
+ *     LeptSnapshot next = doc.with_member("n", 1, LeptSnapshot::number(2));
+ */
+class LeptSnapshot
+{
+  public:
+    LeptSnapshot() {}                                  // null
+    explicit LeptSnapshot(const lept_value &v);        // deep copy of v
+    explicit LeptSnapshot(const LeptJson &doc) : LeptSnapshot(doc.get_value()) {}
+
+    static LeptSnapshot boolean(bool b);
+    static LeptSnapshot number(double n);
+    static LeptSnapshot string(const char *s, size_t len);
+    // trusted JSON text, written out verbatim by stringify(); see LeptJson::lept_set_raw()
+    static LeptSnapshot raw(const char *json, size_t len);
+    static LeptSnapshot array();
+    static LeptSnapshot object();
+
+    lept_type    get_type() const;
+    int          get_boolean() const;
+    double       get_number() const;
+    const char*  get_string() const;
+    size_t       get_string_length() const;
+    size_t       get_array_size() const;
+    LeptSnapshot get_array_element(size_t index) const;
+    size_t       get_object_size() const;
+    const char*  get_object_key(size_t index) const;
+    size_t       get_object_key_length(size_t index) const;
+    LeptSnapshot get_object_value(size_t index) const;
+    // index of the first member with the key, or get_object_size() when there is none
+    size_t       find_object_index(const char *key, size_t klen) const;
+
+    LeptSnapshot with_element(size_t index, const LeptSnapshot &e) const;
+    LeptSnapshot with_appended(const LeptSnapshot &e) const;
+    // replaces the value of the first member with the key, or appends a member
+    LeptSnapshot with_member(const char *key, size_t klen, const LeptSnapshot &v) const;
+    LeptSnapshot without_member(const char *key, size_t klen) const;
+
+    std::string  stringify() const;
+    // true when both share the same root node
+    bool         same(const LeptSnapshot &rhs) const { return n_ == rhs.n_; }
+
+  private:
+    friend class LeptSnapshotCell;
+    struct node;
+    std::shared_ptr<const node> n_;
+
+    explicit LeptSnapshot(std::shared_ptr<const node> n) : n_(std::move(n)) {}
+};
+
+/*
+ * A shared slot holding the current snapshot. Readers load() the latest one
+ * while a writer builds the next from it and store()s it; a reader keeps the
+ * snapshot it loaded for as long as it likes.
+ */
+class LeptSnapshotCell
+{
+  public:
+    LeptSnapshotCell() {}
+    explicit LeptSnapshotCell(const LeptSnapshot &s) : n_(s.n_) {}
+
+    LeptSnapshot load() const               { return LeptSnapshot(std::atomic_load(&n_)); }
+    void         store(const LeptSnapshot &s) { std::atomic_store(&n_, s.n_); }
+
+  private:
+    std::shared_ptr<const LeptSnapshot::node> n_;
+};
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef LEPT_STATIC_H__
+#define LEPT_STATIC_H__
+
+#include "leptjson.h"
+
+/*
+ * JSON literals parsed by the compiler into a read-only tree.
+ *
+ *     LEPT_STATIC_JSON(defaults, "{\"port\":8080,\"hosts\":[\"a\",\"b\"]}");
+ *     size_t i = lept_value_find_object_index(defaults, "port", 4);
+ *     double port = lept_value_get_number(*lept_value_get_object_value(defaults, i));
+ *
+ * `defaults` is a const lept_value& bound to a constant-initialized object
+ * holding the values, members and decoded strings of the literal, so nothing
+ * runs at startup and nothing has to be freed. The tree reads through the
+ * lept_value_* accessors like a parsed one (plain members, no lazy numbers,
+ * no shapes); it lives in read-only memory and must not be written to or
+ * passed to LeptJson::lept_free().
+ *
+ * The grammar and checks are those of LeptJson::parse() with the default
+ * flags, and a malformed literal fails a static_assert; lept_static_check()
+ * gives the parse_return for a literal. Numbers are converted without
+ * strtod(), so they must convert exactly: an integer part of at most 2^53
+ * once trailing zeros move into the exponent, scaled by at most 1e22 either
+ * way. That covers integers up to 2^53 and decimals such as 0.25 or 1.5e-3;
+ * other numbers fail with LEPT_STATIC_INEXACT_NUMBER.
+ */
+#define LEPT_STATIC_JSON(name, literal)                                              \
+    struct name##_lept_source { static constexpr const char* json() { return literal; } }; \
+    constexpr const lept_value &name = lept_static_document<name##_lept_source>::tree.v[0]
+
+// returned by lept_static_check() for a valid number that does not convert exactly
+enum { LEPT_STATIC_INEXACT_NUMBER = 64 };
+
+constexpr const char* lept_static_whitespace(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        ++p;
+    return p;
+}
+
+constexpr int lept_static_literal(const char *&p, const char *literal)
+{
+    for (; *literal; ++p, ++literal)
+        if (*p != *literal)
+            return LEPT_PARSE_INVALID_VALUE;
+    return LEPT_PARSE_OK;
+}
+
+constexpr int lept_static_hex4(const char *&p, unsigned &u)
+{
+    u = 0;
+    for (int i = 0; i < 4; ++i, ++p) {
+        char ch = *p;
+        u <<= 4;
+        if      (ch >= '0' && ch <= '9') u |= ch - '0';
+        else if (ch >= 'A' && ch <= 'F') u |= ch - ('A' - 10);
+        else if (ch >= 'a' && ch <= 'f') u |= ch - ('a' - 10);
+        else return LEPT_PARSE_INVALID_UNICODE_HEX;
+    }
+    return LEPT_PARSE_OK;
+}
+
+// appends a byte to the string being decoded; c is null while only sizes are counted
+constexpr void lept_static_put(char *c, size_t &n, unsigned ch)
+{
+    if (c)
+        c[n] = (char)ch;
+    ++n;
+}
+
+/*
+ * Decodes the string whose opening quote p has just passed into c + n and
+ * NUL-terminates it; `plain` is set as LeptJson sets LEPT_VALUE_FLAG_NO_ESCAPE.
+ */
+constexpr int lept_static_string(const char *&p, char *c, size_t &n, bool &plain)
+{
+    const char *begin = p;
+    size_t head = n;
+    for (;;) {
+        char ch = *p++;
+        switch (ch) {
+            case '\"':
+                plain = (n - head == (size_t)(p - begin - 1));
+                lept_static_put(c, n, '\0');
+                return LEPT_PARSE_OK;
+            case '\0':
+                return LEPT_PARSE_MISS_QUOTATION_MARK;
+            case '\\':
+                switch (*p++) {
+                    case '\"': lept_static_put(c, n, '\"'); break;
+                    case '\\': lept_static_put(c, n, '\\'); break;
+                    case '/':  lept_static_put(c, n, '/');  break;
+                    case 'b':  lept_static_put(c, n, '\b'); break;
+                    case 'f':  lept_static_put(c, n, '\f'); break;
+                    case 'r':  lept_static_put(c, n, '\r'); break;
+                    case 'n':  lept_static_put(c, n, '\n'); break;
+                    case 't':  lept_static_put(c, n, '\t'); break;
+                    case 'u': {
+                        unsigned u = 0, ls = 0;
+                        if (lept_static_hex4(p, u) != LEPT_PARSE_OK)
+                            return LEPT_PARSE_INVALID_UNICODE_HEX;
+                        if (u >= 0xD800 && u <= 0xDBFF) {
+                            if (p[0] != '\\' || p[1] != 'u')
+                                return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                            p += 2;
+                            if (lept_static_hex4(p, ls) != LEPT_PARSE_OK)
+                                return LEPT_PARSE_INVALID_UNICODE_HEX;
+                            if (ls < 0xDC00 || ls > 0xDFFF)
+                                return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                            u = 0x10000 + ((u - 0xD800) << 10) + (ls - 0xDC00);
+                        }
+                        if (u <= 0x7F)
+                            lept_static_put(c, n, u);
+                        else if (u <= 0x7FF) {
+                            lept_static_put(c, n, 0xC0 | (u >> 6));
+                            lept_static_put(c, n, 0x80 | (u & 0x3F));
+                        }
+                        else if (u <= 0xFFFF) {
+                            lept_static_put(c, n, 0xE0 | (u >> 12));
+                            lept_static_put(c, n, 0x80 | ((u >> 6) & 0x3F));
+                            lept_static_put(c, n, 0x80 | (u & 0x3F));
+                        }
+                        else {
+                            lept_static_put(c, n, 0xF0 | (u >> 18));
+                            lept_static_put(c, n, 0x80 | ((u >> 12) & 0x3F));
+                            lept_static_put(c, n, 0x80 | ((u >> 6) & 0x3F));
+                            lept_static_put(c, n, 0x80 | (u & 0x3F));
+                        }
+                        break;
+                    }
+                    default:
+                        return LEPT_PARSE_INVALID_STRING_ESCAPE;
+                }
+                break;
+            default:
+                if ((unsigned char)ch < 0x20)
+                    return LEPT_PARSE_INVALID_STRING_CHAR;
+                lept_static_put(c, n, (unsigned char)ch);
+        }
+    }
+}
+
+// the exact conversion described above: a 53-bit integer times or over a power of ten that is itself exact
+constexpr int lept_static_number(const char *&p, double &d)
+{
+    const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const uint64_t exact = 1ULL << 53;
+    uint64_t m = 0;
+    long e = 0, x = 0;
+    bool minus = false, lost = false;   // lost: a nonzero digit did not fit in m
+    if (*p == '-') { minus = true; ++p; }
+    if (*p == '0') ++p;
+    else if (*p >= '1' && *p <= '9') {
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            if (m <= (UINT64_MAX - 9) / 10) m = m * 10 + (*p - '0');
+            else { ++e; lost = lost || *p != '0'; }
+        }
+    }
+    else
+        return LEPT_PARSE_INVALID_VALUE;
+    if (*p == '.') {
+        if (!(*++p >= '0' && *p <= '9'))
+            return LEPT_PARSE_INVALID_VALUE;
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            if (m <= (UINT64_MAX - 9) / 10) { m = m * 10 + (*p - '0'); --e; }
+            else lost = lost || *p != '0';
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        bool down = false;
+        if (*++p == '+' || *p == '-')
+            down = (*p++ == '-');
+        if (!(*p >= '0' && *p <= '9'))
+            return LEPT_PARSE_INVALID_VALUE;
+        for (; *p >= '0' && *p <= '9'; ++p)
+            if (x < 100000)
+                x = x * 10 + (*p - '0');
+        e += down ? -x : x;
+    }
+    if (m == 0) {
+        d = minus ? -0.0 : 0.0;
+        return LEPT_PARSE_OK;
+    }
+    for (; m > exact && m % 10 == 0; m /= 10) ++e;
+    for (; e > 22 && m <= exact / 10; m *= 10) --e;
+    if (lost || m > exact || e > 22 || e < -22) {
+        long magnitude = e;
+        for (uint64_t t = m; t >= 10; t /= 10)
+            ++magnitude;
+        return magnitude > 308 ? (int)LEPT_PARSE_NUMBER_TOO_BIG : (int)LEPT_STATIC_INEXACT_NUMBER;
+    }
+    d = (e >= 0 ? (double)m * pow10[e] : (double)m / pow10[-e]);
+    if (minus)
+        d = -d;
+    return LEPT_PARSE_OK;
+}
+
+template <class B>
+constexpr int lept_static_key(const char *&p, B &b, char *c)
+{
+    size_t head = b.chars;
+    bool plain = false;
+    if (*p != '\"')
+        return LEPT_PARSE_MISS_KEY;
+    int ret = lept_static_string(++p, c, b.chars, plain);
+    if (ret != LEPT_PARSE_OK)
+        return ret;
+    b.key(head, b.chars - head - 1);
+    p = lept_static_whitespace(p);
+    if (*p != ':')
+        return LEPT_PARSE_MISS_COLON;
+    p = lept_static_whitespace(p + 1);
+    return LEPT_PARSE_OK;
+}
+
+/*
+ * The parse shared by the pass that sizes the tree and the one that builds it.
+ * It runs LeptJson::lept_parse_value's loop with frames in fixed arrays: each
+ * finished value goes to b.put(), and b.close() turns the last n of them into
+ * the array or object being closed. Strings are decoded into c.
+ */
+template <class B>
+constexpr int lept_static_parse(const char *p, B &b, char *c)
+{
+    bool object[LEPT_PARSE_MAX_DEPTH] = {};
+    size_t size[LEPT_PARSE_MAX_DEPTH] = {};
+    size_t depth = 0;
+    int ret = LEPT_PARSE_OK;
+    p = lept_static_whitespace(p);
+    for (;;) {
+        lept_value v(0.0, LEPT_NULL);
+        bool member = depth > 0 && object[depth - 1];
+        switch (*p) {
+            case 'n': ret = lept_static_literal(p, "null"); break;
+            case 't': ret = lept_static_literal(p, "true");  v.type = LEPT_TRUE;  break;
+            case 'f': ret = lept_static_literal(p, "false"); v.type = LEPT_FALSE; break;
+            case '\"': {
+                size_t head = b.chars;
+                bool plain = false;
+                ret = lept_static_string(++p, c, b.chars, plain);
+                v = b.string(head, b.chars - head - 1, plain);
+                break;
+            }
+            case '[': case '{':
+                if (depth == LEPT_PARSE_MAX_DEPTH)
+                    return LEPT_PARSE_DEPTH_EXCEEDED;
+                object[depth] = (*p == '{');
+                size[depth++] = 0;
+                p = lept_static_whitespace(p + 1);
+                if (*p == (object[depth - 1] ? '}' : ']')) {
+                    ++p;
+                    v = b.close(!object[--depth], 0);
+                    break;
+                }
+                if (object[depth - 1] && (ret = lept_static_key(p, b, c)) != LEPT_PARSE_OK)
+                    return ret;
+                continue;
+            case '\0':
+                return LEPT_PARSE_EXPECT_VALUE;
+            default: {
+                double d = 0.0;
+                ret = lept_static_number(p, d);
+                v = lept_value(d, LEPT_NUMBER);
+            }
+        }
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        b.put(v, member);
+
+        // the value is complete: go on with its next sibling, closing finished containers
+        for (;;) {
+            p = lept_static_whitespace(p);
+            if (depth == 0)
+                return *p ? LEPT_PARSE_ROOT_NOT_SINGULAR : LEPT_PARSE_OK;
+            bool in_object = object[depth - 1];
+            ++size[depth - 1];
+            if (*p == ',') {
+                p = lept_static_whitespace(p + 1);
+                if (in_object && (ret = lept_static_key(p, b, c)) != LEPT_PARSE_OK)
+                    return ret;
+                break;
+            }
+            if (*p != (in_object ? '}' : ']'))
+                return in_object ? LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET : LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            ++p;
+            --depth;
+            b.put(b.close(!in_object, size[depth]), depth > 0 && object[depth - 1]);
+        }
+    }
+}
+
+// the first pass: counts what the tree needs
+struct lept_static_sizer
+{
+    int ret;
+    size_t values, members, chars;  // values: the root and all array elements
+
+    constexpr lept_static_sizer() : ret(LEPT_PARSE_OK), values(0), members(0), chars(0) {}
+    constexpr void key(size_t, size_t) {}
+    constexpr lept_value string(size_t, size_t, bool) const { return lept_value(0.0, LEPT_STRING); }
+    constexpr lept_value close(bool array, size_t) const { return lept_value(0.0, array ? LEPT_ARRAY : LEPT_OBJECT); }
+    constexpr void put(const lept_value&, bool member) { ++(member ? members : values); }
+};
+
+constexpr lept_static_sizer lept_static_size(const char *json)
+{
+    lept_static_sizer b;
+    b.ret = lept_static_parse(json, b, nullptr);
+    return b;
+}
+
+// LEPT_PARSE_OK, a parse_return, or LEPT_STATIC_INEXACT_NUMBER
+constexpr int lept_static_check(const char *json)
+{
+    return lept_static_size(json).ret;
+}
+
+/*
+ * The tree of one literal. The elements of each array and the members of each
+ * object are contiguous, as in a parsed tree, and follow the root in v and m.
+ */
+template <size_t NV, size_t NM, size_t NC>
+struct lept_static_tree
+{
+    lept_value v[NV] = {};
+    lept_member m[NM] = {};
+    char c[NC] = {};
+};
+
+/*
+ * The second pass. Pointers in the tree must point into the static object the
+ * tree is copied to, so they are taken from `self`, its final address. Finished
+ * values wait on a stack, as on the parser's, until their container closes and
+ * moves them into place. A member's slot is taken by its key, before nested
+ * members can take theirs.
+ */
+template <size_t NV, size_t NM, size_t NC>
+struct lept_static_builder
+{
+    typedef lept_static_tree<NV, NM, NC> tree;
+
+    const tree *self;
+    tree out;
+    lept_value values[NV];
+    lept_member members[NM];
+    size_t vtop, mtop, vnext, mnext, chars;
+
+    constexpr explicit lept_static_builder(const tree *self)
+        : self(self), out(), values(), members(), vtop(0), mtop(0), vnext(1), mnext(0), chars(0) {}
+
+    constexpr void key(size_t head, size_t len)
+    {
+        // lept_member is a trivial aggregate: every field is given, as a constant expression needs
+        members[mtop++] = lept_member{ const_cast<char*>(self->c + head), len, lept_value() };
+    }
+    constexpr lept_value string(size_t head, size_t len, bool plain) const
+    {
+        return lept_value(lept_value::data(const_cast<char*>(self->c + head), (uint32_t)len), LEPT_STRING,
+                          plain ? LEPT_VALUE_FLAG_NO_ESCAPE : 0);
+    }
+    constexpr lept_value close(bool array, size_t n)
+    {
+        if (array) {
+            lept_value *e = nullptr;
+            if (n) {
+                e = const_cast<lept_value*>(self->v + vnext);
+                for (size_t i = vtop - n; i < vtop; ++i)
+                    out.v[vnext++] = values[i];
+                vtop -= n;
+            }
+            return lept_value(lept_value::data(e, (uint32_t)n), LEPT_ARRAY);
+        }
+        lept_member *m = nullptr;
+        if (n) {
+            m = const_cast<lept_member*>(self->m + mnext);
+            for (size_t i = mtop - n; i < mtop; ++i)
+                out.m[mnext++] = members[i];
+            mtop -= n;
+        }
+        return lept_value(lept_value::data(m, (uint32_t)n), LEPT_OBJECT);
+    }
+    constexpr void put(const lept_value &v, bool member)
+    {
+        if (member)
+            members[mtop - 1].v = v;
+        else
+            values[vtop++] = v;
+    }
+};
+
+template <class Source>
+struct lept_static_document
+{
+    static constexpr lept_static_sizer sizes = lept_static_size(Source::json());
+    static_assert(sizes.ret != LEPT_STATIC_INEXACT_NUMBER,
+                  "JSON literal holds a number that does not convert exactly at compile time");
+    static_assert(sizes.ret == LEPT_PARSE_OK, "malformed JSON literal");
+
+    // never empty, so that a failed literal stops at the static_assert
+    typedef lept_static_builder<sizes.values + 1, sizes.members + 1, sizes.chars + 1> builder;
+
+    static constexpr typename builder::tree build(const typename builder::tree *self)
+    {
+        builder b(self);
+        lept_static_parse(Source::json(), b, b.out.c);
+        b.out.v[0] = b.values[0];
+        return b.out;
+    }
+    static const typename builder::tree tree;
+};
+
+template <class Source>
+constexpr typename lept_static_document<Source>::builder::tree lept_static_document<Source>::tree =
+    lept_static_document<Source>::build(&lept_static_document<Source>::tree);
+
+#endif
@@ -0,0 +1,157 @@
+#include "leptwriter.h"
+#include <cstdio>
+
+LeptWriter::LeptWriter() : first_(true), after_key_(false), root_done_(false)
+{
+    ctx_.json = nullptr;
+    ctx_.size = ctx_.top = 0;
+}
+
+LeptWriter::LeptWriter(char *buf, size_t size) : LeptWriter()
+{
+    // the stack grows by half its size, so a buffer shorter than 2 could not grow
+    if (buf && size >= 2) {
+        ctx_.stack.reset(buf, [](char*) {});
+        ctx_.size = size;
+    }
+}
+
+void LeptWriter::clear()
+{
+    ctx_.top = 0;
+    levels_.clear();
+    first_ = true;
+    after_key_ = root_done_ = false;
+}
+
+// puts the comma before a value or key, and checks that one may come here
+void LeptWriter::separate()
+{
+    if (levels_.empty()) {
+        assert(!root_done_);
+        return;
+    }
+    if (after_key_)
+        return;
+    assert(levels_.back() == '[');
+    if (!first_)
+        *(char*)ctx_.push(1) = ',';
+}
+
+LeptWriter& LeptWriter::begin_object()
+{
+    separate();
+    *(char*)ctx_.push(1) = '{';
+    levels_.push_back('{');
+    first_ = true;
+    after_key_ = false;
+    return *this;
+}
+
+LeptWriter& LeptWriter::end_object()
+{
+    assert(!levels_.empty() && levels_.back() == '{' && !after_key_);
+    *(char*)ctx_.push(1) = '}';
+    levels_.pop_back();
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::begin_array()
+{
+    separate();
+    *(char*)ctx_.push(1) = '[';
+    levels_.push_back('[');
+    first_ = true;
+    after_key_ = false;
+    return *this;
+}
+
+LeptWriter& LeptWriter::end_array()
+{
+    assert(!levels_.empty() && levels_.back() == '[');
+    *(char*)ctx_.push(1) = ']';
+    levels_.pop_back();
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::key(const char *s, size_t len)
+{
+    assert(!levels_.empty() && levels_.back() == '{' && !after_key_);
+    if (!first_)
+        *(char*)ctx_.push(1) = ',';
+    LeptJson::lept_stringify_string(ctx_, s, len);
+    *(char*)ctx_.push(1) = ':';
+    after_key_ = true;
+    return *this;
+}
+
+LeptWriter& LeptWriter::null()
+{
+    separate();
+    memcpy(ctx_.push(4), "null", 4);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::boolean(bool b)
+{
+    separate();
+    if (b)
+        memcpy(ctx_.push(4), "true", 4);
+    else
+        memcpy(ctx_.push(5), "false", 5);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::number(double d)
+{
+    separate();
+    LeptJson::lept_stringify_number(ctx_, d);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::integer(long long i)
+{
+    separate();
+    ctx_.top -= 32 - sprintf((char*)ctx_.push(32), "%lld", i);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::integer(unsigned long long u)
+{
+    separate();
+    ctx_.top -= 32 - sprintf((char*)ctx_.push(32), "%llu", u);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::string(const char *s, size_t len)
+{
+    separate();
+    LeptJson::lept_stringify_string(ctx_, s, len);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::value(const lept_value &v)
+{
+    separate();
+    LeptJson::lept_stringify_value(ctx_, v);
+    finish_value();
+    return *this;
+}
+
+LeptWriter& LeptWriter::raw(const char *json, size_t len)
+{
+    assert(json != nullptr || len == 0);
+    separate();
+    if (len > 0)
+        memcpy(ctx_.push(len), json, len);
+    finish_value();
+    return *this;
+}
@@ -0,0 +1,75 @@
+#ifndef LEPT_WRITER_H__
+#define LEPT_WRITER_H__
+
+#include "leptjson.h"
+#include <string>
+#include <vector>
+
+/*
+ * Writes JSON text directly, without building a lept_value tree.
+ *
+ *     LeptWriter w;
+ *     w.begin_object()
+ *         .key("id").integer(42)
+ *         .key("tags").begin_array().string("a", 1).end_array()
+ *      .end_object();
+ *     std::string json = w.str();
+ *
+ * Strings and numbers go through the same escaping and formatting as
+ * LeptJson::stringify(), and commas and colons are put in by the writer.
+ * Calls out of order (a value where a key is expected, a mismatched end, a
+ * second root) trip an assert in debug builds; release builds write whatever
+ * they are told.
+ *
+ * The output is written into a growable buffer, or into a buffer owned by the
+ * caller until it is full, after which it moves to the heap. data() shows
+ * where it currently is; it is not null-terminated.
+ */
+class LeptWriter
+{
+  public:
+    LeptWriter();
+    LeptWriter(char *buf, size_t size);
+
+    LeptWriter& begin_object();
+    LeptWriter& end_object();
+    LeptWriter& begin_array();
+    LeptWriter& end_array();
+    LeptWriter& key(const char *s, size_t len);
+    LeptWriter& key(const std::string &s)               { return key(s.data(), s.size()); }
+
+    LeptWriter& null();
+    LeptWriter& boolean(bool b);
+    LeptWriter& number(double d);
+    LeptWriter& integer(long long i);
+    LeptWriter& integer(unsigned long long u);
+    // so that integer(42) is not ambiguous between the two above
+    LeptWriter& integer(int i)                          { return integer((long long)i); }
+    LeptWriter& integer(long i)                         { return integer((long long)i); }
+    LeptWriter& integer(unsigned u)                     { return integer((unsigned long long)u); }
+    LeptWriter& integer(unsigned long u)                { return integer((unsigned long long)u); }
+    LeptWriter& string(const char *s, size_t len);
+    LeptWriter& string(const std::string &s)            { return string(s.data(), s.size()); }
+    LeptWriter& value(const lept_value &v);             // a whole subtree, as stringify() writes it
+    LeptWriter& raw(const char *json, size_t len);      // one value already serialized, copied as it is
+
+    // true once the root value has been closed
+    bool        complete() const                        { return levels_.empty() && root_done_; }
+    const char* data() const                            { return ctx_.stack.get(); }
+    size_t      length() const                          { return ctx_.top; }
+    std::string str() const                             { return std::string(ctx_.stack.get(), ctx_.top); }
+    // drops the output but keeps the buffer for the next document
+    void        clear();
+
+  private:
+    LeptJson::lept_context ctx_;
+    std::vector<char> levels_;      // '[' or '{' for each open container
+    bool first_;                    // nothing written yet in the innermost container
+    bool after_key_;                // a key was written and its value is next
+    bool root_done_;
+
+    void separate();
+    void finish_value()                                 { first_ = false; after_key_ = false; root_done_ = levels_.empty(); }
+};
+
+#endif
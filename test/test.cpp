@@ -1,7 +1,22 @@
 #include "../source/leptjson.h"
+#include "../source/leptreclaimer.h"
+#include "../source/leptbind.h"
+#include "../source/lepthash.h"
+#include "../source/leptcache.h"
+#include "../source/leptsnapshot.h"
+#include "../source/leptprojection.h"
+#include "../source/leptextract.h"
+#include "../source/leptwriter.h"
+#include "../source/leptingest.h"
+#include "../source/leptcolumns.h"
+#include "../source/leptstatic.h"
+#include <climits>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 static unsigned main_ret = 0;
 static unsigned test_count = 0;
@@ -30,6 +45,8 @@ static unsigned test_pass = 0;
 #define EXPECT_EQ_SIZE_T(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (size_t)expect, (size_t)actual, "%zu")
 #endif
 
+#define EXPECT_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
+
 static void test_parse_null()
 {
     LeptJson v;
@@ -262,6 +279,56 @@ static void test_stringify_object() {
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+static void test_stringify_escape()
+{
+    LeptJson v;
+    std::string raw, expect = "\"";
+    for (int i = 0; i < 100; ++i) {
+        raw += "plain text run \"quoted\" \\ \x01 \xE2\x82\xAC\n";
+        expect += "plain text run \\\"quoted\\\" \\\\ \\u0001 \xE2\x82\xAC\\n";
+    }
+    expect += "\"";
+    v.set_string(raw.data(), raw.size());
+    size_t len;
+    const char *json = v.stringify(&len);
+    EXPECT_EQ_SIZE_T(expect.size(), len);
+    EXPECT_TRUE(expect == json);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("[\"no escapes here\",\"tab\\there\",\"\"]"));
+    EXPECT_EQ_INT(LEPT_VALUE_FLAG_NO_ESCAPE, v.get_array_element(0)->flags & LEPT_VALUE_FLAG_NO_ESCAPE);
+    EXPECT_EQ_INT(0, v.get_array_element(1)->flags & LEPT_VALUE_FLAG_NO_ESCAPE);
+    EXPECT_EQ_INT(LEPT_VALUE_FLAG_NO_ESCAPE, v.get_array_element(2)->flags & LEPT_VALUE_FLAG_NO_ESCAPE);
+    EXPECT_TRUE(strcmp("[\"no escapes here\",\"tab\\there\",\"\"]", v.stringify()) == 0);
+}
+
+static void test_stringify_parallel()
+{
+    std::string items = "[";
+    for (int i = 0; i < 5000; ++i) {
+        char buf[128];
+        sprintf(buf, "%s{\"id\":%d,\"v\":[%d.5,\"s\\t%d\"],\"o\":{}}", i ? "," : "", i, i, i);
+        items += buf;
+    }
+    items += "]";
+    const std::string docs[] = {
+        items,
+        "{\"meta\":{\"n\":1,\"k\\\"q\":[]},\"data\":" + items + ",\"more\":[" + items + "," + items + "]}",
+        "[[],{},1,\"x\"]",
+        "{}",
+        "123"
+    };
+    for (const auto &json : docs) {
+        for (unsigned threads = 1; threads <= 4; threads += 3) {
+            LeptJson v;
+            size_t len = 0;
+            EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(json));
+            const char *out = v.stringify_parallel(&len, threads);
+            EXPECT_EQ_SIZE_T(json.size(), len);
+            EXPECT_TRUE(json == out);
+        }
+    }
+}
+
 static void test_stringify()
 {
     TEST_ROUNDTRIP("null");
@@ -271,6 +338,8 @@ static void test_stringify()
     test_stringify_string();
     test_stringify_array();
     test_stringify_object();
+    test_stringify_escape();
+    test_stringify_parallel();
 }
 
 static void test_parse_array()
@@ -324,7 +393,6 @@ static void test_parse_array_miss_comma_or_square_brace()
 
 }
 
-#define EXPECT_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
 static void test_parse_object()
 {
     LeptJson v;
@@ -358,7 +426,7 @@ static void test_parse_object()
     EXPECT_EQ_INT(LEPT_ARRAY, v.get_object_value(5)->type);
     EXPECT_EQ_STRING("a", v.get_object_key(5), v.get_object_key_length(5));
     EXPECT_EQ_SIZE_T(3, v.get_object_value(5)->u.a.size);
-    for (int i = 0; i < v.get_object_value(5)->u.a.size; ++i) {
+    for (size_t i = 0; i < lept_value_get_array_size(*v.get_object_value(5)); ++i) {
         auto *e = lept_value_get_array_element(*v.get_object_value(5), i);
         EXPECT_EQ_INT(LEPT_NUMBER, e->type);
         EXPECT_EQ_DOUBLE((double)i, e->u.num);
@@ -369,10 +437,10 @@ static void test_parse_object()
     EXPECT_EQ_SIZE_T(3, v.get_object_value(6)->u.obj.size);
     {
         auto obj = *(v.get_object_value(6));
-        for (int i = 0; i < lept_value_get_object_size(obj); ++i) {
+        for (size_t i = 0; i < lept_value_get_object_size(obj); ++i) {
             auto e = lept_value_get_object_value(obj, i);
             EXPECT_EQ_SIZE_T(1, lept_value_get_object_key_length(obj, i));
-            EXPECT_TRUE('0' + i == lept_value_get_object_key(obj, i)[0]);
+            EXPECT_TRUE((char)('0' + i) == lept_value_get_object_key(obj, i)[0]);
             EXPECT_EQ_INT(LEPT_NUMBER, e->type);
             EXPECT_EQ_DOUBLE((double)i, e->u.num);
         }
@@ -409,6 +477,1055 @@ static void test_parse_object_miss_comma_or_curly_bracket()
     EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, v.parse("{\"a\":1 ]"));
 }
 
+static void test_parse_depth()
+{
+    const size_t depth = 100000;
+    std::string deep = std::string(depth, '[') + std::string(depth, ']');
+
+    TEST_PARSE_ERROR(LEPT_PARSE_DEPTH_EXCEEDED, deep);
+    {
+        LeptJson v;
+        v.set_max_depth(1);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("[1, 2]"));
+        EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse("[1, []]"));
+        EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+        EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse("{\"a\":{\"b\":1}}"));
+        EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+    }
+    {
+        LeptJson v;
+        size_t len = 0;
+        v.set_max_depth(depth);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(deep));
+        EXPECT_EQ_INT(LEPT_ARRAY, v.get_type());
+        auto *json = v.stringify(&len);
+        EXPECT_EQ_SIZE_T(deep.size(), len);
+        EXPECT_TRUE(deep == json);
+        EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, v.parse(deep.substr(0, depth + 10)));
+    }
+}
+
+static void test_parse_size()
+{
+    LeptJson v;
+    v.set_max_size(3);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("[\"abc\",[1,2,3],{\"a\":1,\"b\":2,\"c\":3}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse("\"abcd\""));
+    EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse("[1,2,3,4]"));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse("[[\"x\"],{\"a\":\"y\",\"b\":2,\"c\":3,\"d\":4}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse<LEPT_PARSE_FLAG_SHAPES>("[{\"a\":1,\"b\":2,\"c\":3,\"d\":4}]"));
+    // the limit is on decoded bytes
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("\"a\\u00e9\""));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse("\"ab\\u00e9\""));
+
+    // a root array too long for the limit fails in parallel as it does in sequence
+    std::string big = "[";
+    for (int i = 0; i < 20000; ++i)
+        big += (i ? ",\"s\"" : "\"s\"");
+    big += "]";
+    v.set_max_size(19999);
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse(big));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, v.parse_parallel(big, 4));
+    v.set_max_size(20000);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel(big, 4));
+    EXPECT_EQ_SIZE_T(20000, v.get_array_size());
+}
+
+static void test_parse_flags()
+{
+    const char *json = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-123.5e2,\"s\":\"a\\u00A2\\uD834\\uDD1E\\n\",\"a\":[1,[]]}";
+    const char *expect = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-12350,\"s\":\"a\xC2\xA2\xF0\x9D\x84\x9E\\n\",\"a\":[1,[]]}";
+    LeptJson v;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_TRUSTED>(json));
+    EXPECT_TRUE(strcmp(expect, v.stringify()) == 0);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_DEFAULT>(json));
+    EXPECT_TRUE(strcmp(expect, v.stringify()) == 0);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_NO_ESCAPES>("\"C:\\dir\""));
+    EXPECT_EQ_STRING("C:\\dir", v.get_string(), v.get_string_length());
+    EXPECT_EQ_SIZE_T(6, v.get_string_length());
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_TRUSTED | LEPT_PARSE_FLAG_NO_ESCAPES>("[\"a\\b\", 1]"));
+    EXPECT_EQ_SIZE_T(3, v.get_array_element(0)->u.s.len);
+
+    // structural errors are still reported for trusted input
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, v.parse<LEPT_PARSE_FLAG_TRUSTED>("[1 2]"));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, v.parse<LEPT_PARSE_FLAG_TRUSTED>("1 2"));
+}
+
+#define TEST_UTF8_ERROR(error, json) \
+    do { \
+        LeptJson v; \
+        EXPECT_EQ_INT(error, v.parse<LEPT_PARSE_FLAG_VALIDATE_UTF8>(json)); \
+        EXPECT_EQ_INT(LEPT_NULL, v.get_type()); \
+    } while (0)
+
+static void test_parse_utf8()
+{
+    LeptJson v;
+    std::string s = "\"";
+    for (int i = 0; i < 40; ++i)
+        s += "abc\xE2\x82\xAC\xF0\x9D\x84\x9E\xC2\xA2xyz";
+    s += "\"";
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_VALIDATE_UTF8>(s));
+    EXPECT_EQ_SIZE_T(s.size() - 2, v.get_string_length());
+    EXPECT_EQ_STRING(s.c_str() + 1, v.get_string(), v.get_string_length());
+    EXPECT_TRUE(lept_validate_utf8(s.data(), s.size()));
+
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\x80\"");
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\xC0\xAF\"");          /* overlong */
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\xE0\x80\xAF\"");      /* overlong */
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\xED\xA0\x80\"");      /* surrogate */
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\xF4\x90\x80\x80\"");  /* above U+10FFFF */
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "\"\xE2\x82\"");          /* truncated */
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "[\"abcdefghijklmnopqrstuvwxyz\xFF\"]");
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UTF8, "{\"\xC3\":1}");
+    TEST_UTF8_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uDC00\"");
+    TEST_UTF8_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK, "\"abc\xE2\x82\xAC");
+
+    // without the flag, bytes >= 0x80 pass through unchecked
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("\"\x80\xFF\""));
+    EXPECT_EQ_SIZE_T(2, v.get_string_length());
+
+    EXPECT_TRUE(!lept_validate_utf8("abcdefghijklmnopq\xC2", 18));
+    EXPECT_TRUE(!lept_validate_utf8("\xF0\x9D\x84", 3));
+    EXPECT_TRUE(lept_validate_utf8("", 0));
+}
+
+static void test_reclaimer()
+{
+    std::string json = "[";
+    for (int i = 0; i < 1000; ++i)
+        json += (i ? ",{\"k\":[\"abc\",1]}" : "{\"k\":[\"abc\",1]}");
+    json += "]";
+
+    LeptReclaimer r(2);
+    {
+        LeptJson v;
+        v.set_reclaimer(&r);
+        for (int i = 0; i < 8; ++i) { // more trees than the queue holds
+            EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(json));
+            EXPECT_EQ_SIZE_T(1000, v.get_array_size());
+        }
+        v.clear();
+        EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(json));
+        v.set_string("abc", 3);
+        EXPECT_EQ_STRING("abc", v.get_string(), v.get_string_length());
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(json));
+    }
+    r.flush();
+    EXPECT_EQ_SIZE_T(0, r.pending());
+}
+
+struct bind_point { double x, y; };
+struct bind_shape
+{
+    std::string name;
+    int id;
+    bool closed;
+    std::vector<bind_point> points;
+    std::vector<std::string> tags;
+    long long weight = -1;
+};
+LEPT_BIND(bind_point, LEPT_FIELD(bind_point, x), LEPT_FIELD(bind_point, y))
+LEPT_BIND(bind_shape,
+    LEPT_FIELD(bind_shape, name),
+    LEPT_FIELD(bind_shape, id),
+    LEPT_FIELD(bind_shape, closed),
+    LEPT_FIELD(bind_shape, points),
+    LEPT_FIELD_OPT(bind_shape, tags),
+    LEPT_FIELD_OPT(bind_shape, weight))
+
+static void test_bind()
+{
+    bind_shape s;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(" { \"id\" : 7, \"skip\": {\"a\":[1,\"]}\"]}, \"name\":\"tri\\nangle\", \
+        \"closed\":true, \"points\":[{\"x\":0,\"y\":0},{\"y\":1,\"x\":0.5}], \"tags\":null } ", s));
+    EXPECT_EQ_INT(7, s.id);
+    EXPECT_TRUE(s.name == "tri\nangle");
+    EXPECT_TRUE(s.closed);
+    EXPECT_EQ_SIZE_T(2, s.points.size());
+    EXPECT_EQ_DOUBLE(0.5, s.points[1].x);
+    EXPECT_EQ_DOUBLE(1.0, s.points[1].y);
+    EXPECT_EQ_SIZE_T(0, s.tags.size());
+    EXPECT_TRUE(s.weight == -1);
+
+    s.tags.push_back("a\"b");
+    s.weight = 1LL << 60;
+    std::string json = lept_bind_stringify(s);
+    EXPECT_TRUE(json == "{\"name\":\"tri\\nangle\",\"id\":7,\"closed\":true,"
+        "\"points\":[{\"x\":0,\"y\":0},{\"x\":0.5,\"y\":1}],\"tags\":[\"a\\\"b\"],\"weight\":1152921504606846976}");
+    {
+        bind_shape t;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(json, t));
+        EXPECT_TRUE(lept_bind_stringify(t) == json);
+    }
+
+    bind_point p;
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_FIELD, lept_bind_parse("{\"x\":1}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse("{\"x\":1,\"y\":\"2\"}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse("[1,2]", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_bind_parse("{\"x\" 1}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_bind_parse("{\"x\":1 \"y\":2}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_bind_parse("{\"x\":1,\"y\":2} x", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_bind_parse("{\"x\":1,\"y\":2,\"z\":\"abc", p));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse("{\"name\":\"n\",\"id\":1.5,\"closed\":false,\"points\":[]}", s));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_bind_parse("{\"x\":1,\"z\":[1},\"y\":2}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_bind_parse("{\"x\":1,\"z\":{\"a\":[]]},\"y\":2}", p));
+
+    // integers are read from their text, not through a double
+    const char *fmt = "{\"name\":\"n\",\"id\":%s,\"closed\":false,\"points\":[],\"weight\":%s}";
+    char buf[128];
+    sprintf(buf, fmt, "-2147483648", "9007199254740993");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(buf, s));
+    EXPECT_TRUE(s.id == INT_MIN && s.weight == 9007199254740993LL);
+    sprintf(buf, fmt, "-0", "-9223372036854775808");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(buf, s));
+    EXPECT_TRUE(s.id == 0 && s.weight == LLONG_MIN);
+    sprintf(buf, fmt, "2147483648", "0");
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse(buf, s));
+    sprintf(buf, fmt, "1", "9223372036854775808");
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse(buf, s));
+    sprintf(buf, fmt, "1e2", "0");
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse(buf, s));
+    sprintf(buf, fmt, "1.0", "0");
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse(buf, s));
+
+    std::vector<unsigned long long> u;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse("[18446744073709551615,-0]", u));
+    EXPECT_TRUE(u.size() == 2 && u[0] == ULLONG_MAX && u[1] == 0);
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse("[18446744073709551616]", u));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_bind_parse("[-1]", u));
+}
+
+static void test_parse_parallel()
+{
+    // strings long enough to straddle chunk boundaries, full of commas, brackets and escapes
+    std::string json = " [";
+    for (int i = 0; i < 4000; ++i) {
+        char buf[128];
+        sprintf(buf, "%s{\"id\":%d,\"s\":\"", i ? " , " : "", i);
+        json += buf;
+        for (int j = 0; j < i % 37; ++j)
+            json += (j % 3 == 0) ? "\\\"],{" : (j % 3 == 1) ? "\\\\" : ", [ ";
+        sprintf(buf, "\",\"a\":[%d,[],{}, \"x\"]}", i);
+        json += buf;
+    }
+    json += "] ";
+
+    LeptJson seq;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, seq.parse(json));
+    const std::string expect = seq.stringify();
+    for (unsigned threads = 1; threads <= 4; threads += 3) {
+        LeptJson v;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel(json, threads));
+        EXPECT_EQ_SIZE_T(4000, v.get_array_size());
+        EXPECT_TRUE(expect == v.stringify());
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel<LEPT_PARSE_FLAG_VALIDATE_UTF8>(json, threads));
+        EXPECT_TRUE(expect == v.stringify());
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel<LEPT_PARSE_FLAG_LAZY_NUMBERS>(json, threads));
+        EXPECT_TRUE(expect == v.stringify());
+    }
+
+    // errors anywhere in the input are reported as by parse()
+    const char *damage[] = { "", "]", ",", "\"", "[", "x", "\\" };
+    const size_t at[] = { 1, 2, json.size() / 3, json.size() / 2, json.size() - 3, json.size() - 2 };
+    for (const char *d : damage)
+        for (size_t pos : at) {
+            std::string bad = json.substr(0, pos) + d + json.substr(pos + 1);
+            LeptJson v;
+            int ret = seq.parse(bad);
+            EXPECT_EQ_INT(ret, v.parse_parallel(bad, 4));
+            if (ret != LEPT_PARSE_OK)
+                EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+        }
+    {
+        LeptJson v;
+        v.set_max_depth(3);
+        EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse_parallel(json, 4));
+        v.set_max_depth(4);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel(json, 4));
+    }
+}
+
+#define TEST_EQUAL(json1, json2, equality) \
+    do {\
+        LeptJson v1, v2;\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v1.parse(json1));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v2.parse(json2));\
+        EXPECT_EQ_INT(equality, (int)lept_value_equal(v1.get_value(), v2.get_value()));\
+        LeptHashCache cache;\
+        EXPECT_EQ_INT(equality, (int)cache.equal(v1.get_value(), v2.get_value()));\
+        if (equality)\
+            EXPECT_TRUE(lept_value_hash(v1.get_value()) == lept_value_hash(v2.get_value()));\
+    } while(0)
+
+static void test_hash()
+{
+    TEST_EQUAL("true", "true", 1);
+    TEST_EQUAL("true", "false", 0);
+    TEST_EQUAL("false", "false", 1);
+    TEST_EQUAL("null", "null", 1);
+    TEST_EQUAL("null", "0", 0);
+    TEST_EQUAL("123", "123", 1);
+    TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("0", "-0", 1);
+    TEST_EQUAL("\"abc\"", "\"abc\"", 1);
+    TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
+    TEST_EQUAL("\"a\\u0000b\"", "\"a\\u0000c\"", 0);
+    TEST_EQUAL("[]", "[]", 1);
+    TEST_EQUAL("[]", "{}", 0);
+    TEST_EQUAL("[]", "null", 0);
+    TEST_EQUAL("[1,2,3]", "[1,2,3]", 1);
+    TEST_EQUAL("[1,2,3]", "[1,2,3,4]", 0);
+    TEST_EQUAL("[1,2,3]", "[3,2,1]", 0);
+    TEST_EQUAL("[[]]", "[[]]", 1);
+    TEST_EQUAL("{}", "{}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":2}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"b\":2,\"a\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":3}", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":2,\"c\":3}", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"c\":2}", 0);
+    TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":{}}}}", 1);
+    TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":[]}}}", 0);
+    TEST_EQUAL("{\"a\":[1,{\"x\":1,\"y\":[2]}],\"ab\":null}", "{\"ab\":null,\"a\":[1,{\"y\":[2],\"x\":1}]}", 1);
+    TEST_EQUAL("{\"k\":1,\"k\":2}", "{\"k\":2,\"k\":1}", 0);
+
+    // hashes of unchanged subtrees are reused
+    LeptJson v1, v2;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v1.parse("[{\"a\":[1,2]},{\"b\":[3]},4]"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v2.parse("[{\"a\":[1,2]},{\"b\":[5]},4]"));
+    LeptHashCache cache;
+    EXPECT_TRUE(cache.hash(v1.get_value()) != cache.hash(v2.get_value()));
+    EXPECT_EQ_SIZE_T(10, cache.size());
+    EXPECT_TRUE(!cache.equal(v1.get_value(), v2.get_value()));
+    EXPECT_TRUE(cache.equal(v1.get_value(), v1.get_value()));
+    EXPECT_TRUE(cache.hash(*v1.get_array_element(0)) == cache.hash(*v2.get_array_element(0)));
+    EXPECT_TRUE(lept_value_hash(*v1.get_array_element(1)) == cache.hash(*v1.get_array_element(1)));
+    cache.clear();
+    EXPECT_EQ_SIZE_T(0, cache.size());
+}
+
+static void test_parse_cache()
+{
+    LeptParseCache cache;
+    int ret;
+    std::shared_ptr<const LeptJson> a = cache.parse("{\"k\":[1,2,\"x\"]}", &ret);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, ret);
+    std::shared_ptr<const LeptJson> b = cache.parse("{\"k\":[1,2,\"x\"]}", &ret);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, ret);
+    EXPECT_TRUE(a && a == b);
+    EXPECT_EQ_SIZE_T(1, a->get_object_size());
+    EXPECT_TRUE(cache.parse("{\"k\":[1,2,\"y\"]}") != a);
+    EXPECT_TRUE(cache.parse("{\"k\":[1,2,\"x\"] }") != a);
+    EXPECT_TRUE(cache.parse("[1,") == nullptr);
+    EXPECT_TRUE(cache.parse("[1,", &ret) == nullptr);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, ret);
+    EXPECT_EQ_SIZE_T(1, cache.hits());
+    EXPECT_EQ_SIZE_T(5, cache.misses());
+    EXPECT_EQ_SIZE_T(3, cache.size());
+
+    // least recently used entries go first
+    LeptParseCache small(1 << 20, 2);
+    std::shared_ptr<const LeptJson> one = small.parse("1");
+    small.parse("2");
+    EXPECT_TRUE(small.parse("1") == one);
+    small.parse("3");
+    EXPECT_EQ_SIZE_T(2, small.size());
+    EXPECT_TRUE(small.parse("1") == one);
+    EXPECT_EQ_SIZE_T(2, small.hits());
+    small.parse("2");
+    EXPECT_EQ_SIZE_T(2, small.hits());
+    EXPECT_EQ_DOUBLE(1.0, one->get_number());
+
+    // documents above the byte limit are parsed but not kept
+    LeptParseCache tiny(small.bytes() / 2);
+    EXPECT_TRUE(tiny.parse("[\"a long enough string\"]") != nullptr);
+    EXPECT_EQ_SIZE_T(0, tiny.size());
+    EXPECT_EQ_SIZE_T(0, tiny.bytes());
+    small.clear();
+    EXPECT_EQ_SIZE_T(0, small.size());
+    EXPECT_EQ_SIZE_T(0, small.bytes());
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < 4; ++t)
+        pool.emplace_back([&cache, t]() {
+            for (int i = 0; i < 200; ++i)
+                cache.parse("[" + std::to_string((i + t) % 10) + "]");
+        });
+    for (auto &t : pool)
+        t.join();
+    EXPECT_EQ_SIZE_T(800 + 6, cache.hits() + cache.misses());
+
+    // hits on a large payload, compared outside the lock, all get the one document
+    std::string big = "[" + std::string(1 << 20, ' ') + "1]";
+    std::shared_ptr<const LeptJson> first = cache.parse(big);
+    std::atomic<int> same(0);
+    pool.clear();
+    for (int t = 0; t < 4; ++t)
+        pool.emplace_back([&]() {
+            for (int i = 0; i < 20; ++i)
+                same += (cache.parse(big) == first);
+        });
+    for (auto &t : pool)
+        t.join();
+    EXPECT_EQ_INT(80, same.load());
+}
+
+static void test_snapshot()
+{
+    const char *json = "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"a\\tb\","
+                       "\"a\":[1,[2,{}],\"x\"],\"o\":{\"1\":1,\"2\":[]}}";
+    LeptJson doc;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, doc.parse(json));
+    LeptSnapshot s(doc);
+    EXPECT_TRUE(s.stringify() == doc.stringify());
+    EXPECT_EQ_INT(LEPT_OBJECT, s.get_type());
+    EXPECT_EQ_SIZE_T(7, s.get_object_size());
+    EXPECT_EQ_SIZE_T(3, s.find_object_index("i", 1));
+    EXPECT_EQ_SIZE_T(7, s.find_object_index("z", 1));
+    EXPECT_EQ_DOUBLE(123.0, s.get_object_value(3).get_number());
+    EXPECT_EQ_STRING("a\tb", s.get_object_value(4).get_string(), s.get_object_value(4).get_string_length());
+    EXPECT_EQ_INT(LEPT_NULL, s.get_object_value(0).get_type());
+    EXPECT_EQ_INT(LEPT_TRUE, s.get_object_value(2).get_boolean());
+
+    // updates leave the original alone and share what they do not touch
+    LeptSnapshot a = s.get_object_value(5);
+    LeptSnapshot s2 = s.with_member("a", 1, a.with_element(1, LeptSnapshot::string("y", 1)))
+                       .with_member("new", 3, LeptSnapshot::array().with_appended(LeptSnapshot::number(-1.5)))
+                       .without_member("n", 1);
+    EXPECT_TRUE(s.stringify() == doc.stringify());
+    EXPECT_TRUE(s2.stringify() == "{\"f\":false,\"t\":true,\"i\":123,\"s\":\"a\\tb\","
+                                   "\"a\":[1,\"y\",\"x\"],\"o\":{\"1\":1,\"2\":[]},\"new\":[-1.5]}");
+    EXPECT_TRUE(s2.get_object_value(5).same(s.get_object_value(6)));
+    EXPECT_TRUE(s2.get_object_value(4).get_array_element(0).same(a.get_array_element(0)));
+    EXPECT_TRUE(!s2.get_object_value(4).same(a));
+    EXPECT_TRUE(s.without_member("z", 1).same(s));
+    // replacing a value shares the keys; adding or removing a member copies them
+    EXPECT_TRUE(s.with_member("i", 1, LeptSnapshot::number(0)).get_object_key(3) == s.get_object_key(3));
+    EXPECT_TRUE(s2.get_object_key(3) != s.get_object_key(4));
+    EXPECT_EQ_STRING("s", s2.get_object_key(3), s2.get_object_key_length(3));
+    EXPECT_TRUE(LeptSnapshot::object().with_member("k", 1, LeptSnapshot::boolean(false)).stringify() == "{\"k\":false}");
+    EXPECT_TRUE(LeptSnapshot().stringify() == "null");
+
+    // readers keep the snapshot they loaded while a writer publishes new ones
+    LeptSnapshotCell cell(LeptSnapshot::array());
+    std::atomic<bool> consistent(true);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < 3; ++t)
+        pool.emplace_back([&cell, &consistent]() {
+            for (int i = 0; i < 200; ++i) {
+                LeptSnapshot cur = cell.load();
+                for (size_t j = 0; j < cur.get_array_size(); ++j)
+                    if (cur.get_array_element(j).get_number() != (double)j)
+                        consistent = false;
+            }
+        });
+    for (int i = 0; i < 100; ++i)
+        cell.store(cell.load().with_appended(LeptSnapshot::number(i)));
+    for (auto &t : pool)
+        t.join();
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ_SIZE_T(100, cell.load().get_array_size());
+
+    // deep trees are copied and released without recursion
+    std::string deep(100000, '[');
+    deep += std::string(100000, ']');
+    doc.set_max_depth(100000);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, doc.parse(deep));
+    EXPECT_TRUE(LeptSnapshot(doc).stringify() == deep);
+}
+
+#define TEST_PROJECTION(expect, json, proj)\
+    do {\
+        LeptJson v;\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(json, proj));\
+        EXPECT_EQ_STRING(expect, v.stringify(), strlen(expect));\
+    } while(0)
+
+static void test_parse_projection()
+{
+    const char *json = "{\"id\":7,\"name\":\"x\",\"user\":{\"name\":\"u\",\"age\":3,\"tags\":[1,{\"a\":1}]},"
+                       "\"items\":[{\"k\":1,\"v\":2},{\"v\":[3]},5,{\"k\":{\"z\":[]}}],\"skip\":{\"\\\"}\":[\"]\"]}}";
+    LeptProjection p;
+    TEST_PROJECTION("{}", json, p);
+    p.select("id").select("user.name").select("items.k");
+    TEST_PROJECTION("{\"id\":7,\"user\":{\"name\":\"u\"},\"items\":[{\"k\":1},{},5,{\"k\":{\"z\":[]}}]}", json, p);
+    TEST_PROJECTION("[{\"id\":1},{},[{}]]", "[{\"id\":1,\"x\":2},{\"x\":[1]},[{\"y\":null}]]", p);
+    TEST_PROJECTION("3", "3", p);
+    p.select("user");
+    TEST_PROJECTION("{\"id\":7,\"user\":{\"name\":\"u\",\"age\":3,\"tags\":[1,{\"a\":1}]},"
+                    "\"items\":[{\"k\":1},{},5,{\"k\":{\"z\":[]}}]}", json, p);
+    LeptProjection q;
+    q.select(std::vector<std::string>{"skip", "\"}"});
+    TEST_PROJECTION("{\"skip\":{\"\\\"}\":[\"]\"]}}", json, q);
+
+    // skipped members are not decoded, so they only need to be well bracketed
+    TEST_PROJECTION("{\"id\":1}", "{\"x\":[1e999,\"\\q\"],\"id\":1}", p);
+    LeptJson v;
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, v.parse("{\"x\":[1,2", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, v.parse("{\"x\":\"abc}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, v.parse("{\"x\":1 \"id\":1}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_KEY, v.parse("{\"x\":1,}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, v.parse("{\"x\" 1}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_NUMBER_TOO_BIG, v.parse("{\"x\":1,\"id\":1e999}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, v.parse("{\"x\":1} 2", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, v.parse("{\"user\":{\"x\":1]}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, v.parse("{\"x\":[1},\"id\":2}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, v.parse("{\"x\":[{\"a\":1]],\"id\":2}", p));
+    EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+
+    // skipped members are held to the document's depth limit, as parsed ones are
+    v.set_max_depth(3);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("{\"x\":[[1]],\"id\":2}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse("{\"x\":[[[1]]],\"id\":2}", p));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse("{\"x\":[[[1]]],\"id\":2}"));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse("{\"user\":{\"x\":{\"y\":[]}},\"id\":2}", p));
+    std::string deep = "{\"x\":" + std::string(LEPT_PARSE_MAX_DEPTH + 1, '[') + std::string(LEPT_PARSE_MAX_DEPTH + 1, ']') + "}";
+    v.set_max_depth(LEPT_PARSE_MAX_DEPTH + 2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse(deep));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, v.parse(deep, p)); // the skip holds no more than LEPT_PARSE_MAX_DEPTH
+}
+
+static void test_parse_lazy_numbers()
+{
+    const char *json = "[1.10,-0,1e999,9007199254740993,-9223372036854775808,0.5e1,{\"k\":[123.4500]}]";
+    LeptJson v;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>(json));
+    EXPECT_EQ_STRING(json, v.stringify(), strlen(json));
+
+    const lept_value *e = v.get_array_element(0);
+    size_t len;
+    const char *lexeme = lept_value_get_number_lexeme(*e, len);
+    EXPECT_EQ_STRING("1.10", lexeme, len);
+    EXPECT_TRUE(!(e->flags & LEPT_VALUE_FLAG_NUMBER_CACHED));
+    EXPECT_EQ_DOUBLE(1.1, lept_value_get_number(*e));
+    EXPECT_TRUE(!(e->flags & LEPT_VALUE_FLAG_NUMBER_CACHED)); // reads leave the tree alone
+    EXPECT_EQ_DOUBLE(HUGE_VAL, lept_value_get_number(*v.get_array_element(2)));
+    {
+        std::atomic<int> same(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t)
+            readers.emplace_back([&] {
+                for (int k = 0; k < 100; ++k)
+                    if (lept_value_get_number(*e) == 1.1) ++same;
+            });
+        for (auto &r : readers) r.join();
+        EXPECT_EQ_INT(400, same.load());
+    }
+    v.materialize_numbers();
+    const lept_value *nested = lept_value_get_array_element(*lept_value_get_object_value(*v.get_array_element(6), 0), 0);
+    EXPECT_TRUE(e->flags & LEPT_VALUE_FLAG_NUMBER_CACHED);
+    EXPECT_TRUE(nested->flags & LEPT_VALUE_FLAG_NUMBER_CACHED);
+    EXPECT_EQ_DOUBLE(1.1, lept_value_get_number(*e));
+    EXPECT_EQ_DOUBLE(123.45, lept_value_get_number(*nested));
+    EXPECT_EQ_STRING(json, v.stringify(), strlen(json));
+    {
+        LeptJson w;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, w.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS | LEPT_PARSE_FLAG_SHAPES>("[{\"a\":1.5},{\"a\":2.50}]"));
+        w.materialize_numbers();
+        const lept_value *a = lept_value_get_object_value(*w.get_array_element(1), 0);
+        EXPECT_TRUE(a->flags & LEPT_VALUE_FLAG_NUMBER_CACHED);
+        EXPECT_EQ_DOUBLE(2.5, lept_value_get_number(*a));
+    }
+
+    int64_t i;
+    EXPECT_TRUE(lept_value_get_int64(*v.get_array_element(3), i));
+    EXPECT_TRUE(i == 9007199254740993LL);
+    EXPECT_TRUE(lept_value_get_int64(*v.get_array_element(4), i));
+    EXPECT_TRUE(i == INT64_MIN);
+    EXPECT_TRUE(lept_value_get_int64(*v.get_array_element(5), i));
+    EXPECT_TRUE(i == 5);
+    EXPECT_TRUE(!lept_value_get_int64(*v.get_array_element(0), i));
+    EXPECT_TRUE(!lept_value_get_int64(*v.get_array_element(2), i));
+
+    // the text survives a copy of the document and shows up in comparisons as its value
+    EXPECT_TRUE(LeptSnapshot(v).stringify() == json);
+    LeptJson eager;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, eager.parse("[1.1,0,1,9007199254740992,-9223372036854775808,5,{\"k\":[123.45]}]"));
+    EXPECT_TRUE(!lept_value_equal(v.get_value(), eager.get_value()));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>("[1.10,-0,1,9007199254740992,-9223372036854775808,0.5e1,{\"k\":[123.4500]}]"));
+    EXPECT_TRUE(lept_value_equal(v.get_value(), eager.get_value()));
+    EXPECT_TRUE(lept_value_hash(v.get_value()) == lept_value_hash(eager.get_value()));
+    EXPECT_TRUE(lept_value_get_number_lexeme(*eager.get_array_element(0), len) == nullptr);
+    EXPECT_TRUE(lept_value_get_int64(*eager.get_array_element(4), i));
+    EXPECT_TRUE(i == INT64_MIN);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS | LEPT_PARSE_FLAG_TRUSTED>(" -12.5e-1 "));
+    EXPECT_EQ_DOUBLE(-1.25, v.get_number());
+    EXPECT_EQ_STRING("-12.5e-1", v.stringify(), 8);
+    {
+        LeptJson w;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, w.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>("1.50"));
+        w.set_number(2);
+        EXPECT_EQ_STRING("2", w.stringify(), 1);
+    }
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>("[1.]"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>("[01]"));
+}
+
+// runs `x` over `json` written to a temp file; each match is logged as "pattern:value;"
+static int extract_json(const LeptExtractor &x, const char *json, std::string &log)
+{
+    char path[] = "/tmp/lept_extract_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, json, strlen(json)) != (ssize_t)strlen(json))
+        return LEPT_PARSE_IO_ERROR;
+    close(fd);
+    log.clear();
+    int ret = x.extract(path, [&](size_t p, const lept_value &v) {
+        log += std::to_string(p) + ":" + LeptSnapshot(v).stringify() + ";";
+    });
+    unlink(path);
+    return ret;
+}
+
+static void test_extract()
+{
+    const char *json = " {\"items\":[{\"id\":1,\"tags\":[\"a\",\"b\"]},{\"id\":\"two\",\"x\":{\"id\":3}},{\"y\":null}],"
+                       "\"meta\":{\"name\":\"n\\u0041me\",\"n\\u0061me\":true}} ";
+    LeptExtractor x(7);
+    EXPECT_EQ_INT(0, x.add("items[*].id"));
+    EXPECT_EQ_INT(1, x.add("meta.name"));
+    EXPECT_EQ_INT(2, x.add("items[1]"));
+    EXPECT_EQ_INT(3, x.add(".meta.*"));
+    std::string log;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, extract_json(x, json, log));
+    EXPECT_TRUE(log == "0:1;0:\"two\";2:{\"id\":\"two\",\"x\":{\"id\":3}};"
+                       "1:\"nAme\";3:\"nAme\";1:true;3:true;");
+
+    LeptExtractor root;
+    EXPECT_EQ_INT(0, root.add(""));
+    EXPECT_EQ_INT(1, root.add("[0][1]"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, extract_json(root, "[[1,[]],2]", log));
+    EXPECT_TRUE(log == "1:[];0:[[1,[]],2];");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, extract_json(root, "\"s\"", log));
+    EXPECT_TRUE(log == "0:\"s\";");
+
+    EXPECT_EQ_INT(-1, x.add("a..b"));
+    EXPECT_EQ_INT(-1, x.add("a[x]"));
+    EXPECT_EQ_INT(-1, x.add("a[]"));
+    EXPECT_EQ_INT(-1, x.add("a[1"));
+    EXPECT_EQ_INT(LEPT_PARSE_IO_ERROR, x.extract("/nonexistent/lept.json", [](size_t, const lept_value&) {}));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, extract_json(x, "{\"items\":[1 2]}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, extract_json(x, "{\"items\" [1]}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, extract_json(x, "{\"other\":[1,2", log));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, extract_json(x, "{} x", log));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, extract_json(x, "", log));
+    // matched values are parsed for real, skipped ones only checked for structure
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, extract_json(x, "{\"meta\":{\"name\":nul}}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, extract_json(x, "{\"other\":[nul]}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, extract_json(x, "{\"other\":[1},\"items\":[]}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, extract_json(x, "{\"other\":{\"a\":[]]}", log));
+
+    // a matched value may not outgrow the limit, skipped ones may
+    LeptExtractor small(4, 8);
+    EXPECT_EQ_INT(0, small.add("a"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, extract_json(small, "{\"b\":\"a long string\",\"a\":[1,2,3]}", log));
+    EXPECT_TRUE(log == "0:[1,2,3];");
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, extract_json(small, "{\"a\":\"a long string\"}", log));
+    EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, extract_json(small, "{\"a\":[1,2,3,4,5]}", log));
+}
+
+static void test_writer()
+{
+    LeptWriter w;
+    w.begin_object()
+        .key("n").null()
+        .key(std::string("b")).boolean(true)
+        .key("a").begin_array().number(1.5).integer(-3LL).integer(18446744073709551615ULL)
+                 .string("\"x\"\n", 4).begin_object().end_object().begin_array().end_array().end_array()
+        .key("f").boolean(false)
+     .end_object();
+    EXPECT_TRUE(w.complete());
+    EXPECT_TRUE(w.str() == "{\"n\":null,\"b\":true,\"a\":[1.5,-3,18446744073709551615,\"\\\"x\\\"\\n\",{},[]],\"f\":false}");
+
+    // plain int, long and unsigned literals pick an overload without a suffix
+    w.clear();
+    w.begin_array().integer(42).integer(-7L).integer(8u).integer(9UL).integer((short)-1).end_array();
+    EXPECT_TRUE(w.str() == "[42,-7,8,9,-1]");
+
+    // a subtree from a document comes out as stringify() writes it
+    LeptJson v;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("[ 1 , {\"k\" : \"\\u00e9\"} ]"));
+    w.clear();
+    EXPECT_TRUE(!w.complete());
+    w.begin_array().value(v.get_value()).string(std::string("s")).end_array();
+    EXPECT_TRUE(w.str() == "[[1,{\"k\":\"\xC3\xA9\"}],\"s\"]");
+    w.clear();
+    w.number(0.25);
+    EXPECT_TRUE(w.complete());
+    EXPECT_TRUE(w.str() == "0.25");
+
+    // the caller's buffer is written in place until it fills up
+    char buf[8];
+    LeptWriter small(buf, sizeof(buf));
+    small.begin_array().boolean(true).end_array();
+    EXPECT_TRUE(small.data() == buf);
+    EXPECT_EQ_STRING("[true]", small.data(), small.length());
+    small.clear();
+    small.begin_array().string("longer than the buffer", 22).end_array();
+    EXPECT_TRUE(small.data() != buf);
+    EXPECT_TRUE(small.str() == "[\"longer than the buffer\"]");
+}
+
+static void test_ingest()
+{
+    std::string json = "[";
+    for (int i = 0; i < 200; ++i)
+        json += (i ? ",{\"i\":" : "{\"i\":") + std::to_string(i) + ",\"s\":\"\\u00e9\"}";
+    json += "]";
+    std::string ndjson = "{\"i\":0}\n\n  [1,2]\r\n\"a long line that straddles several blocks\"\n3";
+
+    char path[] = "/tmp/lept_ingest_XXXXXX";
+    int fd = mkstemp(path);
+    EXPECT_TRUE(fd >= 0 && write(fd, json.data(), json.size()) == (ssize_t)json.size());
+    close(fd);
+    char lines_path[] = "/tmp/lept_ingest_XXXXXX";
+    fd = mkstemp(lines_path);
+    EXPECT_TRUE(fd >= 0 && write(fd, ndjson.data(), ndjson.size()) == (ssize_t)ndjson.size());
+    close(fd);
+
+    // both the io_uring and the thread fallback, with reads smaller than the text and queues deeper than it
+    for (int uring = 0; uring < 2; ++uring) {
+        for (unsigned depth = 1; depth <= 4; depth += 3) {
+            LeptIngest in(7, depth, uring != 0);
+            LeptJson doc, expect;
+            EXPECT_EQ_INT(LEPT_PARSE_OK, in.parse(path, doc));
+            EXPECT_EQ_INT(LEPT_PARSE_OK, expect.parse(json));
+            EXPECT_TRUE(lept_value_equal(doc.get_value(), expect.get_value()));
+            EXPECT_EQ_SIZE_T(json.size(), in.stats().bytes);
+            EXPECT_EQ_SIZE_T((json.size() + 6) / 7, in.stats().blocks);
+            EXPECT_TRUE(in.stats().total >= in.stats().io_wait + in.stats().parse);
+            EXPECT_EQ_INT(LEPT_PARSE_OK, in.parse<LEPT_PARSE_FLAG_TRUSTED>(path, doc));
+            EXPECT_EQ_SIZE_T(200, doc.get_array_size());
+
+            std::string log;
+            EXPECT_EQ_INT(LEPT_PARSE_OK, in.parse_ndjson(lines_path, [&](size_t line, const LeptJson &d) {
+                log += std::to_string(line) + ":" + LeptSnapshot(d.get_value()).stringify() + ";";
+            }));
+            EXPECT_TRUE(log == "1:{\"i\":0};3:[1,2];4:\"a long line that straddles several blocks\";5:3;");
+            EXPECT_EQ_SIZE_T(5, in.stats().lines);
+            EXPECT_EQ_SIZE_T(ndjson.size(), in.stats().bytes);
+        }
+    }
+
+    // a bad line stops the batch and is reported by its number
+    fd = open(lines_path, O_WRONLY | O_TRUNC);
+    EXPECT_TRUE(fd >= 0 && write(fd, "1\n{\"a\"}\n2\n", 10) == 10);
+    close(fd);
+    LeptIngest in;
+    size_t count = 0;
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, in.parse_ndjson(lines_path, [&](size_t, const LeptJson&) { ++count; }));
+    EXPECT_EQ_SIZE_T(1, count);
+    EXPECT_EQ_SIZE_T(2, in.stats().lines);
+
+    // a line longer than the limit fails by its number, whether or not its newline ever comes
+    fd = open(lines_path, O_WRONLY | O_TRUNC);
+    std::string long_lines = "1\n\"0123456789\"\n2\n\"01234567890123456789\"";
+    EXPECT_TRUE(fd >= 0 && write(fd, long_lines.data(), long_lines.size()) == (ssize_t)long_lines.size());
+    close(fd);
+    for (size_t block = 4; block <= 64; block *= 16) {
+        LeptIngest small(block);
+        small.set_max_line(12);
+        count = 0;
+        EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, small.parse_ndjson(lines_path, [&](size_t, const LeptJson&) { ++count; }));
+        EXPECT_EQ_SIZE_T(3, count);
+        EXPECT_EQ_SIZE_T(4, small.stats().lines);
+        small.set_max_line(11);
+        count = 0;
+        EXPECT_EQ_INT(LEPT_PARSE_VALUE_TOO_LARGE, small.parse_ndjson(lines_path, [&](size_t, const LeptJson&) { ++count; }));
+        EXPECT_EQ_SIZE_T(1, count);
+        EXPECT_EQ_SIZE_T(2, small.stats().lines);
+    }
+    LeptJson doc;
+    EXPECT_EQ_INT(LEPT_PARSE_IO_ERROR, in.parse("/nonexistent/lept.json", doc));
+    EXPECT_EQ_INT(LEPT_PARSE_IO_ERROR, in.parse("/tmp", doc));
+    unlink(path);
+    unlink(lines_path);
+}
+
+static void test_columns()
+{
+    const char *json = "[{\"id\":1,\"name\":\"a\",\"ok\":true,\"score\":2},"
+                       " {\"name\":\"\\u00e9t\\u00e9\",\"id\":-9223372036854775808,\"score\":null},"
+                       " {\"id\":3,\"extra\":null,\"score\":0.5,\"ok\":false,\"id\":4},"
+                       " {}]";
+    LeptJson v;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>(json));
+    // straight from the text and from a parsed tree, with the same result
+    for (int pass = 0; pass < 2; ++pass) {
+        LeptColumns c;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, pass ? c.convert(v.get_value()) : c.parse(json));
+        EXPECT_EQ_SIZE_T(4, c.rows());
+        EXPECT_EQ_SIZE_T(5, c.size());
+        const lept_column *id = c.find("id", 2), *name = c.find("name", 4), *ok = c.find("ok", 2);
+        const lept_column *score = c.find("score", 5), *extra = c.find("extra", 5);
+        EXPECT_TRUE(id && name && ok && score && extra && !c.find("none", 4));
+        EXPECT_TRUE(&c.column(0) == id);
+
+        EXPECT_EQ_INT(LEPT_COLUMN_INT64, id->type);
+        EXPECT_EQ_SIZE_T(4, id->i64.size());
+        EXPECT_TRUE(id->i64[0] == 1 && id->i64[1] == INT64_MIN && id->i64[2] == 3 && id->i64[3] == 0);
+        EXPECT_TRUE(id->is_valid(2) && !id->is_valid(3));
+
+        EXPECT_EQ_INT(LEPT_COLUMN_STRING, name->type);
+        EXPECT_EQ_SIZE_T(5, name->offsets.size());
+        EXPECT_EQ_STRING("a\xC3\xA9t\xC3\xA9", name->bytes.data(), name->bytes.size());
+        EXPECT_TRUE(name->offsets[1] == 1 && name->offsets[2] == 6 && name->offsets[4] == 6);
+        EXPECT_TRUE(name->is_valid(1) && !name->is_valid(2));
+
+        EXPECT_EQ_INT(LEPT_COLUMN_BOOLEAN, ok->type);
+        EXPECT_TRUE(ok->i64[0] == 1 && ok->i64[2] == 0 && !ok->is_valid(1) && ok->is_valid(2));
+
+        // a whole number column becomes double at the first fraction
+        EXPECT_EQ_INT(LEPT_COLUMN_DOUBLE, score->type);
+        EXPECT_TRUE(score->i64.empty());
+        EXPECT_EQ_SIZE_T(4, score->f64.size());
+        EXPECT_EQ_DOUBLE(2.0, score->f64[0]);
+        EXPECT_EQ_DOUBLE(0.5, score->f64[2]);
+        EXPECT_TRUE(score->is_valid(0) && !score->is_valid(1) && score->is_valid(2));
+
+        EXPECT_EQ_INT(LEPT_COLUMN_NULL, extra->type);
+        EXPECT_TRUE(!extra->is_valid(2));
+    }
+
+    // whole numbers past 2^53 stay exact, and a first value of null is kept over a later one
+    const char *edge = "[{\"n\":9007199254740993,\"k\":null,\"k\":1},{\"k\":2,\"k\":null}]";
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_LAZY_NUMBERS>(edge));
+    for (int pass = 0; pass < 2; ++pass) {
+        LeptColumns c;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, pass ? c.convert(v.get_value()) : c.parse(edge));
+        const lept_column *n = c.find("n", 1), *k = c.find("k", 1);
+        EXPECT_TRUE(n && n->type == LEPT_COLUMN_INT64 && n->i64[0] == 9007199254740993LL);
+        EXPECT_TRUE(k && k->type == LEPT_COLUMN_INT64 && !k->is_valid(0) && k->is_valid(1) && k->i64[1] == 2);
+    }
+
+    // the valid bits carry on past one word
+    std::string many = "[";
+    for (int i = 0; i < 130; ++i)
+        many += (i ? "," : "") + (i % 3 ? "{\"x\":" + std::to_string(i) + "}" : std::string("{}"));
+    many += "]";
+    LeptColumns c;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, c.parse(many));
+    EXPECT_EQ_SIZE_T(130, c.rows());
+    EXPECT_EQ_SIZE_T(3, c.column(0).valid.size());
+    EXPECT_TRUE(c.column(0).is_valid(128) && !c.column(0).is_valid(129) && c.column(0).i64[128] == 128);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, c.parse(" [ ] "));
+    EXPECT_EQ_SIZE_T(0, c.rows());
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.parse("{}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.parse("[1]"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.parse("[{\"a\":[]}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.parse("[{\"a\":1},{\"a\":\"1\"}]"));
+    EXPECT_EQ_SIZE_T(0, c.size());
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.parse("[{\"a\":1.5},{\"a\":true}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, c.parse("[{\"a\":1},"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, c.parse("[{} {}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, c.parse("[{\"a\" 1}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, c.parse("[] x"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse("[{\"a\":1},{\"a\":{}}]"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, c.convert(v.get_value()));
+    EXPECT_EQ_SIZE_T(0, c.rows());
+}
+
+static void test_parse_shapes()
+{
+    const char *json = "[{\"id\":1,\"tag\":\"a\"},{\"id\":2,\"tag\":\"b\"},{\"tag\":\"c\",\"id\":3},"
+                       "{\"id\":4,\"tag\":{\"id\":5,\"tag\":null}},{}]";
+    LeptJson v, plain;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_SHAPES>(json));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, plain.parse(json));
+    EXPECT_TRUE(strcmp(v.stringify(), plain.stringify()) == 0);
+    EXPECT_TRUE(lept_value_equal(v.get_value(), plain.get_value()));
+    EXPECT_TRUE(lept_value_hash(v.get_value()) == lept_value_hash(plain.get_value()));
+    EXPECT_TRUE(LeptSnapshot(v).stringify() == plain.stringify());
+
+    const lept_value &r0 = *v.get_array_element(0), &r1 = *v.get_array_element(1), &r2 = *v.get_array_element(2);
+    const lept_value &r3 = *v.get_array_element(3), &inner = *lept_value_get_object_value(r3, 1);
+    EXPECT_TRUE(lept_value_get_object_shape(r0) != nullptr);
+    EXPECT_TRUE(lept_value_get_object_shape(r0) == lept_value_get_object_shape(r1));
+    EXPECT_TRUE(lept_value_get_object_shape(r0) == lept_value_get_object_shape(r3));
+    EXPECT_TRUE(lept_value_get_object_shape(r0) == lept_value_get_object_shape(inner));
+    EXPECT_TRUE(lept_value_get_object_shape(r0) != lept_value_get_object_shape(r2));
+    EXPECT_EQ_SIZE_T(4, lept_value_get_object_shape(r0)->refs); // three objects and the parse, which is over
+    EXPECT_TRUE(lept_value_get_object_shape(*v.get_array_element(4)) == nullptr);
+    EXPECT_TRUE(lept_value_get_object_shape(*plain.get_array_element(0)) == nullptr);
+    EXPECT_EQ_STRING("tag", lept_value_get_object_key(r2, 0), lept_value_get_object_key_length(r2, 0));
+    EXPECT_EQ_DOUBLE(3.0, lept_value_get_number(*lept_value_get_object_value(r2, 1)));
+
+    // a cache answers for every object of the shape it last saw
+    lept_key_cache cache;
+    EXPECT_EQ_SIZE_T(1, lept_value_find_object_index(r0, "tag", 3, &cache));
+    EXPECT_TRUE(cache.shape == lept_value_get_object_shape(r0));
+    EXPECT_EQ_SIZE_T(1, lept_value_find_object_index(r1, "tag", 3, &cache));
+    EXPECT_EQ_SIZE_T(0, lept_value_find_object_index(r2, "tag", 3, &cache));
+    EXPECT_EQ_SIZE_T(0, lept_value_find_object_index(r2, "tag", 3, &cache));
+    lept_key_cache none;
+    EXPECT_EQ_SIZE_T(2, lept_value_find_object_index(r2, "none", 4, &none));
+    EXPECT_EQ_SIZE_T(2, lept_value_find_object_index(r2, "none", 4, &none));
+    EXPECT_EQ_SIZE_T(1, lept_value_find_object_index(*plain.get_array_element(0), "tag", 3, &cache));
+    EXPECT_EQ_SIZE_T(0, lept_value_find_object_index(*v.get_array_element(4), "id", 2));
+
+    // objects above the size limit keep their own keys
+    std::string wide = "{";
+    for (int i = 0; i <= LEPT_PARSE_SHAPE_MAX_SIZE; ++i)
+        wide += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i);
+    wide += "}";
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_SHAPES>(wide));
+    EXPECT_TRUE(lept_value_get_object_shape(v.get_value()) == nullptr);
+    EXPECT_EQ_SIZE_T(LEPT_PARSE_SHAPE_MAX_SIZE, v.find_object_index("k64", 3));
+
+    // shapes combine with the other flags, parallel parsing, and the views built on the tree
+    std::string records = "[";
+    for (int i = 0; i < 3000; ++i)
+        records += (i ? ",{\"n\":" : "{\"n\":") + std::to_string(i) + ",\"s\":\"x\",\"b\":" + (i % 2 ? "true}" : "null}");
+    records += "]";
+    EXPECT_EQ_INT(LEPT_PARSE_OK, plain.parse(records));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse_parallel<LEPT_PARSE_FLAG_SHAPES | LEPT_PARSE_FLAG_LAZY_NUMBERS>(records, 4));
+    EXPECT_TRUE(lept_value_equal(v.get_value(), plain.get_value()));
+    EXPECT_TRUE(lept_value_get_object_shape(*v.get_array_element(2999)) != nullptr);
+    LeptColumns c;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, c.convert(v.get_value()));
+    EXPECT_EQ_SIZE_T(3000, c.rows());
+    EXPECT_TRUE(c.find("n", 1)->i64[2999] == 2999);
+    LeptProjection proj;
+    proj.select("tag");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_SHAPES>(json, &proj));
+    EXPECT_TRUE(strcmp(v.stringify(), "[{\"tag\":\"a\"},{\"tag\":\"b\"},{\"tag\":\"c\"},{\"tag\":{\"id\":5,\"tag\":null}},{}]") == 0);
+    EXPECT_TRUE(lept_value_get_object_shape(*v.get_array_element(0)) == lept_value_get_object_shape(*v.get_array_element(2)));
+
+    // keys of every length wait on the parse stack, and only a new shape copies them
+    const char *keys = "[{\"\":1,\"a\\u00e9\":\"s\",\"abcdefgh\":[{\"abcdefg\":\"t\"}]},"
+                       "{\"\":2,\"a\\u00e9\":\"u\",\"abcdefgh\":[]}]";
+    EXPECT_EQ_INT(LEPT_PARSE_OK, v.parse<LEPT_PARSE_FLAG_SHAPES>(keys));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, plain.parse(keys));
+    EXPECT_TRUE(strcmp(v.stringify(), plain.stringify()) == 0);
+    EXPECT_TRUE(lept_value_get_object_shape(*v.get_array_element(0)) == lept_value_get_object_shape(*v.get_array_element(1)));
+    EXPECT_EQ_STRING("a\xC3\xA9", lept_value_get_object_key(*v.get_array_element(1), 1), 3);
+
+    // shapes of a tree that fails half way are freed with it
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, v.parse<LEPT_PARSE_FLAG_SHAPES>("[{\"a\":1},{\"a\":{\"a\":2} x"));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, v.parse<LEPT_PARSE_FLAG_SHAPES>("[{\"a\":1},{\"a\":"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, v.parse<LEPT_PARSE_FLAG_SHAPES>("{\"s\":\"x\",\"o\":{\"t\":\"y\",\"u\" 1}}"));
+    EXPECT_EQ_INT(LEPT_NULL, v.get_type());
+}
+
+LEPT_STATIC_JSON(static_config,
+    " { \"name\" : \"lept\\u00e9\\uD834\\uDD1E\", \"port\": 8080, \"ratio\": -1.5e-3, \"big\": 1e23,"
+    "   \"flags\": [true, false, null, [], {}], \"nested\": {\"tab\": \"a\\tb\", \"list\": [0, -0, 9007199254740992]} } ");
+
+static void test_static_json()
+{
+    LeptJson doc;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, doc.parse(static_config_lept_source::json()));
+    EXPECT_TRUE(lept_value_equal(static_config, doc.get_value()));
+    size_t i = lept_value_find_object_index(static_config, "name", 4);
+    const lept_value *name = lept_value_get_object_value(static_config, i);
+    EXPECT_EQ_STRING("lept\xC3\xA9\xF0\x9D\x84\x9E", lept_value_get_string(*name), lept_value_get_string_length(*name));
+    EXPECT_EQ_SIZE_T(10, lept_value_get_string_length(*name));
+    EXPECT_EQ_DOUBLE(8080.0, lept_value_get_number(*lept_value_get_object_value(static_config, 1)));
+    EXPECT_EQ_DOUBLE(-1.5e-3, lept_value_get_number(*lept_value_get_object_value(static_config, 2)));
+    const lept_value *flags = lept_value_get_object_value(static_config, 4);
+    EXPECT_EQ_SIZE_T(5, lept_value_get_array_size(*flags));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_value_get_array_element(*flags, 4)->type);
+    EXPECT_EQ_SIZE_T(0, lept_value_get_object_size(*lept_value_get_array_element(*flags, 4)));
+
+    // strings carry the same NO_ESCAPE flags, so the writer gives the parser's output
+    LeptWriter w;
+    w.value(static_config);
+    EXPECT_TRUE(w.str() == doc.stringify());
+
+    // a literal in a function is built at compile time as well
+    LEPT_STATIC_JSON(answer, "42");
+    static_assert(lept_static_check("42") == LEPT_PARSE_OK, "");
+    EXPECT_EQ_DOUBLE(42.0, lept_value_get_number(answer));
+
+    // the same errors as the parser; these would fail a LEPT_STATIC_JSON at compile time
+    const char *bad[] = { "", "nul", "[1,]", "[1 2]", "[1", "{\"a\" 1}", "{1:2}", "{\"a\":1", "\"\\x\"",
+                          "\"\\uD800\"", "\"\\u00G0\"", "\"a", "\"\x01\"", "01", "1.", "-", "1e", "1e400", "1 2" };
+    for (const char *json : bad)
+        EXPECT_EQ_INT(doc.parse(json), lept_static_check(json));
+    std::string deep(LEPT_PARSE_MAX_DEPTH + 1, '[');
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_static_check(deep.c_str()));
+
+    // numbers that convert exactly match strtod(); the others are refused
+    const char *exact[] = { "0", "-0", "1", "0.1", "3.14159", "1e22", "1e-22", "1e23", "1234567890123456e-5",
+                            "9007199254740992", "4.9e-5", "2.5E+10", "100000000000000000000000000000" };
+    for (const char *json : exact) {
+        const char *p = json;
+        double d = 1.0;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_static_number(p, d));
+        EXPECT_EQ_DOUBLE(strtod(json, nullptr), d);
+        EXPECT_TRUE(std::signbit(d) == (json[0] == '-'));
+    }
+    EXPECT_EQ_INT(LEPT_STATIC_INEXACT_NUMBER, lept_static_check("1.7976931348623157e308"));
+    EXPECT_EQ_INT(LEPT_STATIC_INEXACT_NUMBER, lept_static_check("9007199254740993"));
+    EXPECT_EQ_INT(LEPT_STATIC_INEXACT_NUMBER, lept_static_check("5e-324"));
+}
+
+static void test_raw()
+{
+    const char *body = "{\"id\": 7, \"tags\": [\"a\", \"b\"]}";
+    size_t len = strlen(body), n;
+    LeptJson v;
+    v.set_raw(body, len);
+    EXPECT_EQ_INT(LEPT_RAW, v.get_type());
+    EXPECT_TRUE(strcmp(body, v.stringify()) == 0); // verbatim, spaces included
+    EXPECT_TRUE(lept_value_get_raw(v.get_value(), n) != nullptr);
+    EXPECT_EQ_SIZE_T(len, n);
+    v.set_raw("[ 1 ]", 5);
+    EXPECT_TRUE(strcmp("[ 1 ]", v.stringify()) == 0); // not the output cached for the first text
+
+    // spliced into an envelope, on each stringify path
+    LeptJson env;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, env.parse("{\"status\":200,\"body\":[null]}"));
+    lept_value *slot = lept_value_get_array_element(*env.get_object_value(1), 0);
+    LeptJson::lept_set_raw(*slot, body, len);
+    const char *expect = "{\"status\":200,\"body\":[{\"id\": 7, \"tags\": [\"a\", \"b\"]}]}";
+    EXPECT_TRUE(strcmp(expect, env.stringify()) == 0);
+    EXPECT_TRUE(strcmp(expect, env.stringify_parallel(nullptr, 2)) == 0);
+    EXPECT_TRUE(LeptSnapshot(env).stringify() == expect);
+    LeptWriter w;
+    w.begin_object().key("status").integer(200LL).key("body").begin_array().raw(body, len).end_array().end_object();
+    EXPECT_TRUE(w.str() == expect);
+    LeptSnapshot s = LeptSnapshot::object().with_member("status", 6, LeptSnapshot::number(200))
+                         .with_member("body", 4, LeptSnapshot::array().with_appended(LeptSnapshot::raw(body, len)));
+    EXPECT_TRUE(s.stringify() == expect);
+
+    // hashing and comparing look at the tree the text stands for
+    LeptJson parsed;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, parsed.parse("{\"status\":200,\"body\":[{\"tags\":[\"a\",\"b\"],\"id\":7}]}"));
+    EXPECT_TRUE(lept_value_equal(env.get_value(), parsed.get_value()));
+    EXPECT_TRUE(lept_value_equal(parsed.get_value(), env.get_value()));
+    EXPECT_TRUE(lept_value_hash(env.get_value()) == lept_value_hash(parsed.get_value()));
+    LeptJson other;
+    other.set_raw("[1,", 3);
+    EXPECT_TRUE(!lept_value_equal(other.get_value(), parsed.get_value()));
+    EXPECT_TRUE(lept_value_equal(other.get_value(), other.get_value()));
+
+    // expanding parses in place; text that does not parse stays raw
+    EXPECT_EQ_INT(LEPT_PARSE_OK, LeptJson::lept_expand_raw(*slot));
+    EXPECT_EQ_INT(LEPT_OBJECT, slot->type);
+    EXPECT_EQ_SIZE_T(1, lept_value_find_object_index(*slot, "tags", 4));
+    w.clear();
+    w.value(env.get_value());
+    EXPECT_TRUE(w.str() == "{\"status\":200,\"body\":[{\"id\":7,\"tags\":[\"a\",\"b\"]}]}");
+    lept_value bad = other.get_value();
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, LeptJson::lept_expand_raw(bad));
+    EXPECT_EQ_INT(LEPT_RAW, bad.type);
+
+    // a raw root is freed by a reclaimer like any other value
+    LeptReclaimer r;
+    v.set_reclaimer(&r);
+    v.set_raw("true", 4);
+    v.set_string("", 0);
+    r.flush();
+    EXPECT_EQ_SIZE_T(0, r.pending());
+    v.set_reclaimer(nullptr);
+}
+
 static void test_access_string()
 {
     LeptJson v;
@@ -468,6 +1585,25 @@ static void test_parse()
     test_parse_expect_value();
     test_parse_invalid_value();
     test_parset_root_not_singular();
+    test_parse_depth();
+    test_parse_size();
+    test_parse_flags();
+    test_parse_utf8();
+    test_reclaimer();
+    test_bind();
+    test_parse_parallel();
+    test_hash();
+    test_parse_cache();
+    test_snapshot();
+    test_parse_projection();
+    test_parse_lazy_numbers();
+    test_extract();
+    test_writer();
+    test_ingest();
+    test_columns();
+    test_parse_shapes();
+    test_static_json();
+    test_raw();
     test_access();
 }
 